@@ -27,10 +27,130 @@
 import os
 import sys
 import glob
+import io
 import time
+import struct
+import zlib
 import serial
 
 
+########################################################################    
+## rleReader
+#
+#  Decodes a run length encoded read payload (BIN_FLAG_RLE), the data is
+#  cut in stages of stageSize bytes and every token covers count stages:
+#  0 count stage  - literal stage
+#  1 count value  - stages filled with value
+#  2 count        - stages repeating the previous stage
+########################################################################
+class rleReader:
+    
+    def __init__(self, port, stageSize, size):
+        self.port = port
+        self.stageSize = stageSize
+        self.remaining = size
+        self.prev = b""
+        self.runType = 0
+        self.runCount = 0
+        self.runValue = 0
+        self.pending = bytearray()
+        
+########################################################################    
+## read
+#  \param self self
+#  \param n number of decoded bytes to return
+#  
+#  Returns up to n decoded bytes, less if the UMD stops sending
+########################################################################
+    def read(self, n):
+        
+        out = bytearray()
+        while len(out) < n:
+            if self.pending:
+                take = self.pending[:n - len(out)]
+                del self.pending[:len(take)]
+                out += take
+                continue
+            
+            stageSize = min(self.stageSize, self.remaining)
+            if stageSize == 0:
+                break
+            if self.runCount == 0:
+                token = self.port.read(2)
+                if len(token) != 2:
+                    break
+                self.runType, self.runCount = token[0], token[1]
+                if self.runType == 1:
+                    value = self.port.read(1)
+                    if len(value) != 1:
+                        break
+                    self.runValue = value[0]
+            
+            if self.runType == 0:
+                stage = self.port.read(stageSize)
+                if len(stage) != stageSize:
+                    break
+            elif self.runType == 1:
+                stage = bytes([self.runValue]) * stageSize
+            elif self.runType == 2:
+                stage = self.prev[:stageSize]
+            else:
+                raise IOError("umd.rleReader - bad token 0x{0:X}".format(self.runType))
+            
+            self.runCount -= 1
+            self.remaining -= stageSize
+            self.prev = stage
+            self.pending += stage
+        
+        return bytes(out)
+
+########################################################################    
+## rleEncode
+#  \param data bytes to compress
+#  \param stageSize bytes per stage
+#  
+#  Run length encode data with the tokens rleReader decodes, the same way
+#  the UMD compresses its read stream
+########################################################################
+def rleEncode(data, stageSize):
+    
+    out = bytearray()
+    prev = None
+    runType = None
+    runCount = 0
+    runValue = 0
+    
+    for pos in range(0, len(data), stageSize):
+        stage = data[pos:pos + stageSize]
+        if stage.count(stage[0]) == len(stage):
+            if runCount and runType == 1 and runValue == stage[0] and runCount < 0xFF:
+                runCount += 1
+                prev = stage
+                continue
+            stageType = 1
+        elif stage == prev:
+            if runCount and runType == 2 and runCount < 0xFF:
+                runCount += 1
+                continue
+            stageType = 2
+        else:
+            stageType = 0
+        
+        # flush the run being accumulated
+        if runCount:
+            out += bytes([runType, runCount]) + ( bytes([runValue]) if runType == 1 else b"" )
+            runCount = 0
+        
+        if stageType == 0:
+            out += bytes([0, 1]) + stage
+        else:
+            runType, runCount, runValue = stageType, 1, stage[0]
+        prev = stage
+    
+    if runCount:
+        out += bytes([runType, runCount]) + ( bytes([runValue]) if runType == 1 else b"" )
+    return bytes(out)
+
 ## Universal Mega Dumper
 #
 #  All communications with the UMD are handled by the umddb class
@@ -75,6 +195,9 @@ class umddb:
     sfReadChunkSize = 1024
     sfWriteChunkSize = 512
     sfBurnChunkSize = 256
+    sfCompress = True       # store serial flash images compressed when it makes them smaller
+    sfImageHeader = struct.Struct("<II")
+    sfImageMagic = 0x5A444D55   # "UMDZ", BIN_IMAGE_MAGIC
     sramWriteChunkSize = 128
     
     checksumRom = 0
@@ -83,6 +206,47 @@ class umddb:
                    
     opTime = ""
     romInfo = {}
+    
+    # binary framed protocol, must match binproto.h
+    binSync = 0xA5
+    binOpcodes = {"ping": 0,
+                  "setmode": 1,
+                  "getid": 2,
+                  "romsize": 3,
+                  "erase": 4,
+                  "read": 5,
+                  "program": 6,
+                  "writesram": 7,
+                  "exit": 8,
+                  "stream": 9,
+                  "hash": 10,
+                  "verify": 11,
+                  "blank": 12,
+                  "eraserange": 13,
+                  "progstream": 14,
+                  }
+    binFlagSram = 0x01
+    binFlagRle = 0x02
+    binFlagCrc = 0x04
+    binFlagVerify = 0x08
+    binFlagErase = 0x10
+    binProgramFail = struct.Struct("<I")
+    programErrors = []      # addresses that read back wrong during the last verified rom write
+    programErrorCount = 0   # may exceed len(programErrors), the UMD lists at most 32 per block
+    writeVerified = False   # the last rom write was read back by the UMD while programming
+    binHash = struct.Struct("<IIHH")
+    binVerifyBlockSize = 4096
+    binRleStageSize = 128
+    compressReads = True    # ask the UMD to run length encode streamed reads
+    crc32 = None            # CRC-32 calculated by the UMD for the last streamed read
+    hashTimeout = 60        # seconds, BIN_OP_HASH only answers once the whole range is read
+    eraseTimeout = 600      # seconds, BIN_FLAG_ERASE withholds credits during the erase and while the staged data is programmed
+    binHeader = struct.Struct("<BBBBII")
+    binResponse = struct.Struct("<BBBBI")
+    binaryMode = False
+    binSeq = 0
+    binCreditSize = 1024
+    streamWindow = 32   # credits in flight, 32KB
 
 ########################################################################    
 ## The Constructor
@@ -145,6 +309,142 @@ class umddb:
             sys.exit(1)
 
 
+########################################################################    
+## enterBinary
+#  \param self self
+#  
+#  Switch the UMD to the binary framed protocol, returns False when the
+#  firmware does not support it in which case text commands must be used.
+#  Does nothing when already in binary mode, the firmware would take a
+#  second "binmode" for a frame and never answer it
+########################################################################
+    def enterBinary(self):
+        
+        if self.binaryMode:
+            return True
+        
+        self.serialPort.write(bytes("binmode\r\n","utf-8"))
+        response = self.serialPort.readline().decode("utf-8", errors="replace")
+        if response == "binary\r\n":
+            self.binaryMode = True
+        else:
+            # older firmware lists its commands, drop all of it
+            time.sleep(0.1)
+            self.serialPort.reset_input_buffer()
+            self.binaryMode = False
+        return self.binaryMode
+
+########################################################################    
+## exitBinary
+#  \param self self
+#  
+#  Return the UMD to text commands
+########################################################################
+    def exitBinary(self):
+        
+        if self.binaryMode:
+            self.binCommand("exit")
+            self.binaryMode = False
+
+########################################################################    
+## binCommand
+#  \param self self
+#  \param opcode key in binOpcodes
+#  \param address 32bit address field
+#  \param length 32bit length field, defaults to the payload length
+#  \param flags command flags
+#  \param payload bytes sent right after the header
+#  \param readPayload read the response payload, else the caller does
+#  
+#  Send one binary command and return its response payload
+########################################################################
+    def binCommand(self, opcode, address=0, length=None, flags=0, payload=b"", readPayload=True):
+        
+        if length is None:
+            length = len(payload)
+        self.binSeq = (self.binSeq + 1) & 0xFF
+        header = self.binHeader.pack(self.binSync, self.binOpcodes.get(opcode), flags, self.binSeq, address, length)
+        self.serialPort.write(header + payload)
+        return self.binReadResponse(opcode, readPayload)
+
+########################################################################    
+## binReadResponse
+#  \param self self
+#  \param opcode key in binOpcodes of the command being answered
+#  \param readPayload read the response payload, else the caller does
+#  \param received response bytes the caller already read
+#  
+#  Read the response to the last binary command and return its payload
+########################################################################
+    def binReadResponse(self, opcode, readPayload=True, received=b""):
+        
+        response = received + self.serialPort.read(self.binResponse.size - len(received))
+        if len(response) != self.binResponse.size:
+            raise IOError("umd.binCommand - no response to {0}".format(opcode))
+        sync, op, status, seq, respLength = self.binResponse.unpack(response)
+        if sync != self.binSync or seq != self.binSeq:
+            raise IOError("umd.binCommand - bad response to {0}".format(opcode))
+        if status != 0:
+            raise IOError("umd.binCommand - {0} failed with status {1}".format(opcode, status))
+        
+        if readPayload:
+            return self.serialPort.read(respLength)
+        return respLength
+
+########################################################################    
+## binProgramStream
+#  \param self self
+#  \param address where data starts on the cartridge
+#  \param data bytes to program
+#  \param progress called with the number of bytes sent so far
+#  
+#  Program data with a single BIN_OP_PROGSTREAM, the UMD grants a credit
+#  for every binCreditSize bytes it can buffer and programs one block
+#  while it receives the next. Every byte/word is read back, the
+#  addresses that differ are added to programErrors. With erase the UMD
+#  erases the range first and takes the upload into its serial flash
+#  during the erase
+########################################################################
+    def binProgramStream(self, address, data, progress=None, erase=False):
+        
+        flags = self.binFlagVerify
+        timeout = self.serialPort.timeout
+        if erase:
+            flags |= self.binFlagErase
+            self.serialPort.timeout = self.eraseTimeout
+        
+        self.binSeq = (self.binSeq + 1) & 0xFF
+        header = self.binHeader.pack(self.binSync, self.binOpcodes.get("progstream"), flags, self.binSeq, address, len(data))
+        self.serialPort.write(header)
+        
+        try:
+            sent = 0
+            credits = 0
+            while sent < len(data):
+                if credits == 0:
+                    credit = self.serialPort.read(1)
+                    if len(credit) != 1:
+                        raise IOError("umd.binProgramStream - no credit from the UMD")
+                    # credits are never the sync byte, the UMD refused the command
+                    if credit[0] == self.binSync:
+                        self.binReadResponse("progstream", received=credit)
+                        raise IOError("umd.binProgramStream - unexpected response")
+                    credits += credit[0]
+                    continue
+            
+                self.serialPort.write(data[sent:sent + self.binCreditSize])
+                sent = min(sent + self.binCreditSize, len(data))
+                credits -= 1
+                if progress is not None:
+                    progress(sent)
+        
+            fails = self.binReadResponse("progstream")
+            self.programErrorCount += self.binProgramFail.unpack(fails[:4])[0]
+            for i in range(4, len(fails), 4):
+                self.programErrors.append(self.binProgramFail.unpack(fails[i:i + 4])[0])
+        finally:
+            self.serialPort.timeout = timeout
+
 ########################################################################    
 ## getFlashID
 #  \param self self
@@ -153,6 +453,19 @@ class umddb:
 ########################################################################     
     def getFlashID(self):
         
+        # single round trip in binary mode
+        if self.enterBinary():
+            data = self.binCommand("getid")
+            self.exitBinary()
+            manufacturer, device, flashType, buffermode, size = struct.unpack("<BBBBI", data)
+            self.flashIDData.clear()
+            self.flashIDData.update({"Manufacturer": hex(manufacturer) })
+            self.flashIDData.update({"Device": hex(device) })
+            self.flashIDData.update({"Type": hex(flashType) })
+            self.flashIDData.update({"Size": hex(size) })
+            self.flashIDData.update({"Buffered Mode": hex(buffermode) })
+            return
+        
         # query the chip
         self.serialPort.write(bytes("getid\r\n","utf-8"))
         # clear current info
@@ -296,25 +609,34 @@ class umddb:
             fileSize = int(response)
             print("reading {0} bytes from {1}".format(fileSize, sfFilename))
             
+            data = bytearray()
+            pos = 0
+            while pos < fileSize:
+                # read chunkSize or less
+                if (fileSize - pos) > self.sfReadChunkSize: 
+                    sizeOfRead = self.sfReadChunkSize
+                else:
+                    sizeOfRead = (fileSize - pos)
+                
+                # send 1 byte to dumper to signal we are ready to receive this chunk                         
+                # self.serialPort.write(bytes("0","utf-8"))
+                response = self.serialPort.read(sizeOfRead)
+                data += response
+                pos += sizeOfRead
+                self.printProgress( (pos/fileSize) , self.progressBarSize )
+            
+            # compressed images are saved expanded
+            if len(data) >= self.sfImageHeader.size:
+                magic, length = self.sfImageHeader.unpack(data[:self.sfImageHeader.size])
+                if magic == self.sfImageMagic:
+                    data = rleReader(io.BytesIO(data[self.sfImageHeader.size:]), self.binRleStageSize, length).read(length)
+            
             try:
                 os.remove(outfile)
             except OSError:
                 pass
             with open(outfile, "wb+") as f:
-                pos = 0
-                while pos < fileSize:
-                    # read chunkSize or less
-                    if (fileSize - pos) > self.sfReadChunkSize: 
-                        sizeOfRead = self.sfReadChunkSize
-                    else:
-                        sizeOfRead = (fileSize - pos)
-                    
-                    # send 1 byte to dumper to signal we are ready to receive this chunk                         
-                    # self.serialPort.write(bytes("0","utf-8"))
-                    response = self.serialPort.read(sizeOfRead)
-                    f.write(response)
-                    pos += sizeOfRead
-                    self.printProgress( (pos/fileSize) , self.progressBarSize )
+                f.write(data)
             
         else:
             print("file {0} not found in serial flash".format(sfFilename))
@@ -351,6 +673,9 @@ class umddb:
             
             response = self.serialPort.readline().decode("utf-8")
             while (response != "done\r\n"):
+                if (response == "error\r\n"):
+                    print("\nthe cartridge flash failed to program after {0} bytes".format(pos))
+                    break
                 pos = int(response)
                 self.printProgress( (pos/fileSize) , self.progressBarSize )
                 response = self.serialPort.readline().decode("utf-8")
@@ -375,7 +700,16 @@ class umddb:
             
         startTime = time.time()
         pos = 0
-        fileSize = os.path.getsize(filename)
+        with open(filename, "rb") as f:
+            data = f.read()
+        
+        # the UMD expands compressed images while it burns them
+        if self.sfCompress:
+            packed = self.sfImageHeader.pack(self.sfImageMagic, len(data)) + rleEncode(data, self.binRleStageSize)
+            if len(packed) < len(data):
+                print("compressed {0} bytes to {1}".format(len(data), len(packed)))
+                data = packed
+        fileSize = len(data)
 
         cmd = "sfwrite {0} {1} {2}\r\n".format(sfFilename, fileSize, self.sfWriteChunkSize)
         #print("command = {0}".format(cmd), end="")
@@ -386,21 +720,20 @@ class umddb:
         #response = self.serialPort.readline().decode("utf-8") 
         #print(response)
         
-        with open(filename, "rb") as f:
-            while( pos < fileSize ):
-                if( ( fileSize - pos ) >= self.sfWriteChunkSize):
-                    sizeOfWrite = self.sfWriteChunkSize
-                else:
-                    sizeOfWrite = ( fileSize - pos )
-                    
-                line = f.read(sizeOfWrite)
-                self.serialPort.write(line)
-                
-                #wait here while the flash is programmed
-                response = self.serialPort.readline().decode("utf-8") 
+        while( pos < fileSize ):
+            if( ( fileSize - pos ) >= self.sfWriteChunkSize):
+                sizeOfWrite = self.sfWriteChunkSize
+            else:
+                sizeOfWrite = ( fileSize - pos )
                 
-                pos += sizeOfWrite
-                self.printProgress( (pos/fileSize) , self.progressBarSize )
+            line = data[pos:pos + sizeOfWrite]
+            self.serialPort.write(line)
+            
+            #wait here while the flash is programmed
+            response = self.serialPort.readline().decode("utf-8") 
+            
+            pos += sizeOfWrite
+            self.printProgress( (pos/fileSize) , self.progressBarSize )
         
         self.opTime = time.time() - startTime
     
@@ -422,8 +755,63 @@ class umddb:
             print(response, end="", flush=True)
             response = self.serialPort.read(1).decode("utf-8")
         
+        # "done" or "error" follows the "!"
+        response = self.serialPort.readline().decode("utf-8")
+        self.opTime = time.time() - start_time
+        print("")
+        if response != "done\r\n":
+            raise IOError("umd.eraseChip - the flash failed to erase or timed out")
+
+########################################################################    
+## blankCheck
+#  \param self self
+#  \param address the address at which to start
+#  \param size how many bytes to check, 0 for the whole flash
+#  
+#  Ask the UMD whether a range of the flash is erased, returns None when
+#  blank else the address of the first byte that is not 0xFF
+########################################################################
+    def blankCheck(self, address, size):
+        
+        startTime = time.time()
+        cmd = "blank {0} {1}\r\n".format(address, size)
+        self.serialPort.write(bytes(cmd,"utf-8"))
+        
+        response = self.serialPort.read(1).decode("utf-8")
+        while response == ".":
+            response = self.serialPort.read(1).decode("utf-8")
+        
+        response = self.serialPort.readline().decode("utf-8")
+        self.opTime = time.time() - startTime
+        if response == "blank\r\n":
+            return None
+        return int(response)
+
+########################################################################    
+## eraseRange
+#  \param self self
+#  \param address the address at which to start
+#  \param size how many bytes need to be erased
+#  
+#  Erase only the flash sectors covering the range, the UMD erases the
+#  whole chip when it doesn't know the sector map of the flash
+########################################################################
+    def eraseRange(self, address, size):
+        
+        start_time = time.time()
+        self.serialPort.write(bytes("erasesec {0} {1}\r\n".format(address, size), "utf-8"))
+        
+        response = self.serialPort.read(1).decode("utf-8")
+        while response == ".":
+            print(response, end="", flush=True)
+            response = self.serialPort.read(1).decode("utf-8")
+        
+        # "done" or "error" follows the "!"
+        response = self.serialPort.readline().decode("utf-8")
         self.opTime = time.time() - start_time
         print("")
+        if response != "done\r\n":
+            raise IOError("umd.eraseRange - the flash failed to erase 0x{0:X} bytes at 0x{1:X} or timed out".format(size, address))
 
 ########################################################################    
 ## programSingle
@@ -479,6 +867,10 @@ class umddb:
         startAddress = address
         startTime = time.time()
         
+        # block reads use binary frames when the firmware supports them
+        if target not in ["byte", "word", "sbyte", "sword"]:
+            self.enterBinary()
+        
         # read from UMD, output to console
         if outfile == "console":
             while address < endAddress:
@@ -488,20 +880,7 @@ class umddb:
                 else:
                     sizeOfRead = (endAddress - address)
                 
-                if( target == "byte" or target == "word" ):
-                    cmd = "{0} {1}\r\n".format(readCmd, address)
-                elif( target == "sbyte" or target == "sword" ):
-                    cmd = "{0} {1} s\r\n".format(readCmd, address)
-                elif( target == "save" ):
-                    cmd = "{0} {1} {2} s\r\n".format(readCmd, address, sizeOfRead)
-                # temporary hack for testing SF II on PCE
-                elif( self.cartType == "PCEngine" and endAddress > 0x100000):
-                    cmd = "{0} {1} {2} b\r\n".format(readCmd, address, sizeOfRead)
-                else:
-                    cmd = "{0} {1} {2}\r\n".format(readCmd, address, sizeOfRead)
-                
-                self.serialPort.write(bytes(cmd, "utf-8"))
-                response = self.serialPort.read(sizeOfRead)
+                response = self.readChunk(readCmd, target, address, sizeOfRead, endAddress)
                 
                 # loop through results, pretty display to console
                 respCount = len(response)
@@ -545,6 +924,12 @@ class umddb:
             except OSError:
                 pass
             with open(outfile, "wb+") as f:
+                # the whole range in a single streamed command
+                if self.binaryMode:
+                    flags = self.binFlagSram if target == "save" else 0
+                    self.readStream(address, size, flags, f)
+                    address = endAddress
+                    
                 while address < endAddress:
                     # read chunkSize or less
                     if (endAddress - address) > self.readChunkSize: 
@@ -552,27 +937,102 @@ class umddb:
                     else:
                         sizeOfRead = (endAddress - address)
                     
-                    if( target == "byte" or target == "word" ):
-                        cmd = "{0} {1}\r\n".format(readCmd, address)
-                    elif( target == "sbyte" or target == "sword" ):
-                        cmd = "{0} {1} s\r\n".format(readCmd, address)
-                    elif( target == "save" ):
-                        cmd = "{0} {1} {2} s\r\n".format(readCmd, address, sizeOfRead)
-                    # temporary hack for testing SF II on PCE
-                    elif( self.cartType == "PCEngine" and endAddress > 0x100000):
-                        cmd = "{0} {1} {2} b\r\n".format(readCmd, address, sizeOfRead)
-                    else:
-                        cmd = "{0} {1} {2}\r\n".format(readCmd, address, sizeOfRead)
-                                                            
-                    # send command to Teensy, read response    
-                    self.serialPort.write(bytes(cmd,"utf-8"))
-                    response = self.serialPort.read(sizeOfRead)
+                    response = self.readChunk(readCmd, target, address, sizeOfRead, endAddress)
                     f.write(response)
                     address += sizeOfRead
                     self.printProgress( ((address - startAddress)/size) , self.progressBarSize )
-                    
+        
+        self.exitBinary()
         self.opTime = time.time() - startTime
 
+########################################################################    
+## readStream
+#  \param self self
+#  \param address the address at which to start the read operation
+#  \param size how many bytes to read
+#  \param flags binary command flags
+#  \param f the file in which to write the binary data
+#  
+#  Read the whole range with one streamed command, the UMD sends as long
+#  as it holds credits and a new credit is granted for every credit
+#  sized chunk consumed here. With compressReads the UMD run length
+#  encodes the stream, credits still count decoded bytes. The UMD ends
+#  the stream with the CRC-32 of the data, it is checked against the
+#  received data and kept in crc32
+########################################################################
+    def readStream(self, address, size, flags, f):
+        
+        if self.compressReads:
+            flags |= self.binFlagRle
+            source = rleReader(self.serialPort, self.binRleStageSize, size)
+        else:
+            source = self.serialPort
+        
+        flags |= self.binFlagCrc
+        crc = 0
+        
+        window = min(self.streamWindow, (size + self.binCreditSize - 1) // self.binCreditSize)
+        self.binCommand("stream", address, size, flags, payload=bytes([window]), readPayload=False)
+        granted = window * self.binCreditSize
+        pos = 0
+        
+        while pos < size:
+            sizeOfRead = min(self.binCreditSize, size - pos)
+            response = source.read(sizeOfRead)
+            if len(response) != sizeOfRead:
+                raise IOError("umd.readStream - stream stalled at 0x{0:X}".format(address + pos))
+            # keep the window full
+            if granted < size:
+                self.serialPort.write(bytes([1]))
+                granted += self.binCreditSize
+            f.write(response)
+            crc = zlib.crc32(response, crc)
+            pos += sizeOfRead
+            if (pos % self.readChunkSize) == 0 or pos == size:
+                self.printProgress( (pos/size) , self.progressBarSize )
+        
+        # the UMD's CRC of what it read follows the data
+        trailer = self.serialPort.read(4)
+        if len(trailer) != 4:
+            raise IOError("umd.readStream - missing CRC")
+        self.crc32 = struct.unpack("<I", trailer)[0]
+        if self.crc32 != crc:
+            raise IOError("umd.readStream - CRC mismatch, UMD 0x{0:08X} received 0x{1:08X}".format(self.crc32, crc))
+
+########################################################################    
+## readChunk
+#  \param self self
+#  \param readCmd the text read command
+#  \param target what memory to read from the UMD
+#  \param address the address at which to start the read operation
+#  \param sizeOfRead how many bytes to read
+#  \param endAddress end of the whole read operation
+#  
+#  Read one chunk, with a binary frame when in binary mode else with
+#  the text command
+########################################################################
+    def readChunk(self, readCmd, target, address, sizeOfRead, endAddress):
+        
+        if self.binaryMode:
+            flags = self.binFlagSram if target == "save" else 0
+            return self.binCommand("read", address, sizeOfRead, flags)
+        
+        if( target == "byte" or target == "word" ):
+            cmd = "{0} {1}\r\n".format(readCmd, address)
+        elif( target == "sbyte" or target == "sword" ):
+            cmd = "{0} {1} s\r\n".format(readCmd, address)
+        elif( target == "save" ):
+            cmd = "{0} {1} {2} s\r\n".format(readCmd, address, sizeOfRead)
+        # temporary hack for testing SF II on PCE
+        elif( self.cartType == "PCEngine" and endAddress > 0x100000):
+            cmd = "{0} {1} {2} b\r\n".format(readCmd, address, sizeOfRead)
+        else:
+            cmd = "{0} {1} {2}\r\n".format(readCmd, address, sizeOfRead)
+        
+        # send command to Teensy, read response
+        self.serialPort.write(bytes(cmd,"utf-8"))
+        return self.serialPort.read(sizeOfRead)
+
 ########################################################################    
 ## write
 #  \param self self
@@ -580,12 +1040,19 @@ class umddb:
 #  \param target what memory to write on the UMD
 #  \param filename the local file to write
 #  
+#  \param erase erase the rom sectors the file covers first
+#  
 #  Write the contents of a local file to the CD Backup RAM Cart.
+#  In binary mode rom writes are read back by the UMD as they are
+#  programmed, the addresses that differ are kept in programErrors
 # def read(self, address, size, width, target, outfile):
 ######################################################################## 
-    def write(self, address, target, filename):       
+    def write(self, address, target, filename, erase=False):       
         
         startTime = time.time()
+        self.writeVerified = False
+        self.programErrors = []
+        self.programErrorCount = 0
         fileSize = os.path.getsize(filename)
         blockSize = self.writeBlockSize.get(target)
         width = self.busWidth.get(self.cartType)
@@ -613,6 +1080,47 @@ class umddb:
         else:    
             pass
     
+        # rom and save writes use binary frames when the firmware supports them
+        binOpcode = {"rom": "program", "save": "writesram"}.get(target)
+        if binOpcode is not None:
+            self.enterBinary()
+        
+        # without binary commands the erase comes first
+        if erase and target == "rom" and not self.binaryMode:
+            self.eraseRange(address, fileSize)
+        
+        # the UMD picks buffered programming from the flash ID
+        if target == "rom":
+            if self.binaryMode:
+                self.binCommand("getid")
+            else:
+                self.serialPort.write(bytes("getid\r\n","utf-8"))
+    
+        # the UMD receives the next block while it programs the current one,
+        # one stream per run of blocks that aren't blank
+        if self.binaryMode and target == "rom":
+            with open(filename, "rb") as f:
+                data = f.read()
+            # the erase must cover the blank blocks too, the UMD skips them
+            if erase:
+                self.binProgramStream(address, data,
+                    lambda sent: self.printProgress( (sent/fileSize) , self.progressBarSize ), erase=True)
+                pos = fileSize
+            while( pos < fileSize ):
+                if data[pos:pos + blockSize].count(b"\xff") == len(data[pos:pos + blockSize]):
+                    pos += blockSize
+                    continue
+                end = pos
+                while end < fileSize and data[end:end + blockSize].count(b"\xff") != len(data[end:end + blockSize]):
+                    end += blockSize
+                end = min(end, fileSize)
+                start = pos
+                self.binProgramStream(address + start, data[start:end],
+                    lambda sent: self.printProgress( ((start + sent)/fileSize) , self.progressBarSize ))
+                pos = end
+            self.printProgress( 1 , self.progressBarSize )
+            pos = fileSize
+        
         with open(filename, "rb") as f:
             while( pos < fileSize ):
                 if( ( fileSize - pos ) >= blockSize):
@@ -621,17 +1129,28 @@ class umddb:
                     sizeOfWrite = ( fileSize - pos )
                     
                 line = f.read(sizeOfWrite)
-                cmd = "{0} {1} {2}\r\n".format(writeCmd, address, sizeOfWrite)   
-                self.serialPort.write(bytes(cmd,"utf-8"))
-                self.serialPort.write(line)
                 
-                # UMD writes "done\n\r" when complete"
-                response = self.serialPort.readline().decode("utf-8")
+                # erased flash already reads 0xFF, padding doesn't need to be sent
+                if target == "rom" and line.count(b"\xff") == sizeOfWrite:
+                    pass
+                elif self.binaryMode:
+                    self.binCommand(binOpcode, address, payload=line)
+                else:
+                    cmd = "{0} {1} {2}\r\n".format(writeCmd, address, sizeOfWrite)   
+                    self.serialPort.write(bytes(cmd,"utf-8"))
+                    self.serialPort.write(line)
+                    
+                    # UMD writes "done\n\r" when complete, "error" if the flash failed
+                    response = self.serialPort.readline().decode("utf-8")
+                    if response.startswith("error"):
+                        raise IOError("umd.write - the flash failed to program at {0}".format(hex(address)))
                 
                 pos += sizeOfWrite
                 address += sizeOfWrite
                 self.printProgress( (pos/fileSize) , self.progressBarSize )
-            
+        
+        self.writeVerified = ( target == "rom" and self.binaryMode )
+        self.exitBinary()
         self.opTime = time.time() - startTime
 
 
@@ -687,6 +1206,74 @@ class umddb:
         print("")
 
 
+########################################################################    
+## hash
+#  \param self self
+#  \param address the address at which to start
+#  \param size how many bytes to hash, 0 for the ROM size from the header
+#  \param target "rom" or "save"
+#  
+#  The UMD reads the range and only sends back its CRC-32 (crc32) along
+#  with the console checksum (checksumCalc, checksumRom) for the ROM
+########################################################################
+    def hash(self, address, size, target):
+        
+        startTime = time.time()
+        if not self.enterBinary():
+            raise IOError("umd.hash - the UMD firmware does not support binary commands")
+        
+        flags = self.binFlagSram if target == "save" else 0
+        timeout = self.serialPort.timeout
+        self.serialPort.timeout = self.hashTimeout
+        try:
+            data = self.binCommand("hash", address, size, flags)
+        finally:
+            self.serialPort.timeout = timeout
+        self.exitBinary()
+        
+        self.crc32, self.romsize, self.checksumCalc, self.checksumRom = self.binHash.unpack(data)
+        self.opTime = time.time() - startTime
+
+########################################################################    
+## verifyFile
+#  \param self self
+#  \param address the address at which the file should be found
+#  \param target "rom" or "save"
+#  \param filename the local file to compare against
+#  
+#  Send the CRC-32 of every block of the file, the UMD checks them
+#  against the cartridge and answers with a bitmap of the mismatching
+#  blocks. The start addresses of the bad blocks are kept in
+#  verifyErrors
+########################################################################
+    def verifyFile(self, address, target, filename):
+        
+        startTime = time.time()
+        with open(filename, "rb") as f:
+            data = f.read()
+        
+        crcs = bytearray()
+        for pos in range(0, len(data), self.binVerifyBlockSize):
+            crcs += struct.pack("<I", zlib.crc32(data[pos:pos + self.binVerifyBlockSize]))
+        
+        if not self.enterBinary():
+            raise IOError("umd.verifyFile - the UMD firmware does not support binary commands")
+        flags = self.binFlagSram if target == "save" else 0
+        timeout = self.serialPort.timeout
+        self.serialPort.timeout = self.hashTimeout
+        try:
+            bitmap = self.binCommand("verify", address, len(data), flags, payload=bytes(crcs))
+        finally:
+            self.serialPort.timeout = timeout
+        self.exitBinary()
+        
+        self.verifyErrors = []
+        for block in range(len(crcs) // 4):
+            if (block // 8) >= len(bitmap) or bitmap[block // 8] & (1 << (block % 8)):
+                self.verifyErrors.append(address + block * self.binVerifyBlockSize)
+        
+        self.opTime = time.time() - startTime
+
 ########################################################################    
 ## verify(self):
 #  \param self self
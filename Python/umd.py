@@ -59,6 +59,26 @@ def extractHeader(start, size, ifile, ofile):
             read_bytes = fread.read(size)
             fwrite.write(read_bytes)
 
+########################################################################    
+## verifyFile(umd, address, target, filename):
+#  \param umd the connected umddb
+#  \param address where the file starts on the cartridge
+#  \param target "rom" or "save"
+#  \param filename the local file to compare against
+#
+#  Verify the cartridge against a local file with per block CRCs and
+#  list the blocks that differ
+########################################################################
+def verifyFile(umd, address, target, filename):
+    print("verifying {0} against {1} at address 0x{2:X}".format(filename, target, address))
+    umd.verifyFile(address, target, filename)
+    for blockAddress in umd.verifyErrors:
+        print("mismatch in block 0x{0:X}-0x{1:X}".format(blockAddress, blockAddress + umd.binVerifyBlockSize - 1))
+    if umd.verifyErrors:
+        print("verify failed, {0} bad blocks".format(len(umd.verifyErrors)))
+    else:
+        print("verify ok")
+
 ####################################################################################
 ## Main
 ####################################################################################
@@ -98,6 +118,12 @@ if __name__ == "__main__":
                                 help="Calculate ROM checksum", 
                                 action="store_true")
 
+    readWriteArgs.add_argument("--crc", 
+                                help="Calculate the CRC-32 and checksum on the UMD without transferring the data, ROM by default", 
+                                choices=["rom", "save"], 
+                                nargs="?",
+                                const="rom",
+                                type=str)
     readWriteArgs.add_argument("--byteswap", 
                                 nargs=1, 
                                 help="Reverse the endianness of a file", 
@@ -105,7 +131,11 @@ if __name__ == "__main__":
                                 metavar=('file to byte swap'))
     
     readWriteArgs.add_argument("--verify",  
-                                help="Verify cartridge against a file in the serial flash", 
+                                help="Verify cartridge against a file in the serial flash (--sfile) or a local file (--file)", 
+                                action="store_true")
+    
+    readWriteArgs.add_argument("--bench", 
+                                help="Measure sustained ROM read throughput, reads --size bytes (default 4MB) and discards them", 
                                 action="store_true")
     
     readWriteArgs.add_argument("--rd", 
@@ -119,10 +149,14 @@ if __name__ == "__main__":
                                 type=str)
     
     readWriteArgs.add_argument("--clr", 
-                                help="Clear a memory in the UMD", 
+                                help="Clear a memory in the UMD, for rom --size or --file limit the erase to the sectors they cover", 
                                 choices=["rom", "rom2", "save", "bram", "sf"], 
                                 type=str)
     
+    parser.add_argument("--erase", 
+                        help="With --wr rom, erase the sectors the file covers first, the UMD takes the file while it erases", 
+                        action="store_true")
+    
     parser.add_argument("--addr", 
                         nargs=1, 
                         help="Address for current command", 
@@ -285,7 +319,9 @@ if __name__ == "__main__":
                     print("Unable to determine rom size.")
             if byteCount > 0:
                 umd.read(address, byteCount, args.rd, ofile)
-                print("read {0} bytes completed in {1:.3f} s".format(byteCount, umd.opTime))
+                print("read {0} bytes completed in {1:.3f} s ({2:.0f} bytes/s)".format(byteCount, umd.opTime, byteCount / umd.opTime))
+                if umd.crc32 is not None:
+                    print("CRC-32 0x{0:08X}".format(umd.crc32))
                 if args.dat:
                     matched_name = ""
                     with open(ofile, 'rb') as in_file:
@@ -336,9 +372,22 @@ if __name__ == "__main__":
             
         # erase the flash rom on a cartridge, some cart types have multiple chips, need to figure out if more than 1 is connected
         elif args.clr == "rom":
-            print("erasing flash chip...")
-            umd.eraseChip(0)
-            print("erase flash chip completed in {0:.3f} s".format(umd.opTime))
+            # only the sectors a file or --size needs
+            if byteCount == 0 and args.file != "console":
+                byteCount = os.path.getsize(args.file)
+            
+            # new carts come blank, the erase is the longest part of a burn
+            firstUsed = umd.blankCheck(address, byteCount)
+            if firstUsed is None:
+                print("flash chip is blank, skipping erase ({0:.3f} s)".format(umd.opTime))
+            elif byteCount > 0:
+                print("erasing 0x{0:X} bytes of flash at address 0x{1:X}, first programmed byte at 0x{2:X}...".format(byteCount, address, firstUsed))
+                umd.eraseRange(address, byteCount)
+                print("erase flash sectors completed in {0:.3f} s".format(umd.opTime))
+            else:
+                print("erasing flash chip, first programmed byte at 0x{0:X}...".format(firstUsed))
+                umd.eraseChip(0)
+                print("erase flash chip completed in {0:.3f} s".format(umd.opTime))
                 
             
     # write operations
@@ -361,9 +410,24 @@ if __name__ == "__main__":
             # first check if a local file is to be written to the cartridge
             if args.file != "console":
                 print("burning {0} contents to ROM at address 0x{1:X}".format(args.file, address))
-                umd.write(address, args.wr, args.file)
+                umd.write(address, args.wr, args.file, erase=args.erase)
                 print("burn {0} completed in {1:.3f} s".format(args.file, umd.opTime))
                 
+                # the UMD read every word back while programming, no second pass needed
+                if umd.writeVerified:
+                    for failAddress in umd.programErrors:
+                        print("mismatch at 0x{0:X}".format(failAddress))
+                    if umd.programErrorCount:
+                        print("verify failed, {0} bad bytes/words".format(umd.programErrorCount))
+                    else:
+                        print("verify ok")
+                # the verify needs binary commands too, older firmware can't
+                elif umd.enterBinary():
+                    verifyFile(umd, address, args.wr, args.file)
+                    print("verify completed in {0:.3f} s".format(umd.opTime))
+                else:
+                    print("verify skipped, the UMD firmware does not support binary commands")
+                
             else:
                 if args.sfile:
                     umd.sfBurnCart(args.sfile)
@@ -410,6 +474,27 @@ if __name__ == "__main__":
         
         print("checksum completed in {0:.3f} s, calculated 0x{1:X}, value in header is 0x{2:X}".format(opTime, checksumCalc, checksumRom))
         
+    # CRC-32 on the UMD, nothing but the result is transferred
+    elif args.crc:
+        umd = umddb(cartType, args.port)
+        umd.hash(address, byteCount, args.crc)
+        print("crc completed in {0:.3f} s, CRC-32 0x{1:08X} on 0x{2:X} bytes".format(umd.opTime, umd.crc32, umd.romsize))
+        if args.crc == "rom":
+            print("checksum calculated 0x{0:X}, value in header is 0x{1:X}".format(umd.checksumCalc, umd.checksumRom))
+        if args.dat:
+            crc = "{0:08X}".format(umd.crc32)
+            matched_name = ""
+            for _, elem in iterparse(args.dat[0]):
+                if elem.tag == 'rom':
+                    if elem.attrib.get('crc', "").upper() == crc:
+                        matched_name = elem.attrib['name']
+                        break
+                elem.clear()
+            if matched_name != "":
+                print("Found match in dat: " + matched_name)
+            else:
+                print("Unable to find a match in {0}".format(args.dat[0]))
+        
     # Verify operations
     elif args.verify:
         # declare UMD
@@ -418,10 +503,27 @@ if __name__ == "__main__":
         # read a file from the UMD's serial flash - the file is read in its entirety and output to a local file
         if args.sfile:
             umd.verify(args.sfile)
+            print("verify completed in {0:.3f} s".format(umd.opTime))
+        # compare a local file with block CRCs calculated on the UMD
+        elif args.file != "console":
+            verifyFile(umd, address, "rom", args.file)
+            print("verify completed in {0:.3f} s".format(umd.opTime))
         else:
-            print("must specify a remote --SFILE to verify against the cartridge, run --rd sflist")
+            print("must specify a remote --SFILE or a local --FILE to verify against the cartridge, run --rd sflist")
 
-        print("verify completed in {0:.3f} s".format(umd.opTime))
+    
+    # read throughput benchmark, a full 4MB Genesis dump by default
+    elif args.bench:
+        umd = umddb(cartType, args.port)
+        if byteCount == 0:
+            byteCount = 4 * (2**20)
+        print("benchmarking {0} byte read starting at address 0x{1:X} from {2}".format(byteCount, address, cartType))
+        umd.read(address, byteCount, "rom", "_bench.bin")
+        try:
+            os.remove("_bench.bin")
+        except OSError:
+            pass
+        print("read {0} bytes in {1:.3f} s, sustained {2:.0f} bytes/s".format(byteCount, umd.opTime, byteCount / umd.opTime))
     
     # swap endianess of file    
     elif args.byteswap:
@@ -0,0 +1,193 @@
+/*******************************************************************//**
+ *  \file binproto.h
+ *  \author René Richard
+ *  \brief Binary framed command protocol. The text command "binmode"
+ *         switches the UMD into binary mode, from then on every command
+ *         is a fixed little endian header optionally followed by a payload
+ *         and every command is answered by a fixed response header
+ *         optionally followed by a payload. BIN_OP_EXIT returns to text
+ *         commands.
+ *
+ * \copyright This file is part of Universal Mega Dumper.
+ *
+ *   Universal Mega Dumper is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Universal Mega Dumper is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Universal Mega Dumper.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef binproto_h
+#define binproto_h
+
+#include <stdint.h>
+
+#define BIN_SYNC                0xA5    ///< first byte of every command and response header
+#define BIN_CREDIT_SIZE         1024    ///< bytes BIN_OP_STREAM may send per credit granted by the PC
+#define BIN_RLE_STAGE_SIZE      128     ///< uncompressed bytes per compression stage, see bin_rle_e
+#define BIN_VERIFY_BLOCK_SIZE   4096    ///< bytes covered by each CRC-32 of a BIN_OP_VERIFY, bit n of the bitmap is block n
+#define BIN_PROGRAM_MAX_FAILS   32      ///< addresses listed by BIN_OP_PROGRAM with BIN_FLAG_VERIFY, the count includes the others
+#define BIN_IMAGE_MAGIC         0x5A444D55  ///< "UMDZ", first field of a bin_image_t
+
+/*
+ * BIN_OP_STREAM flow control: after the command header the PC sends
+ * credit bytes, each byte holds a number of credits (1 to 255) and every
+ * credit allows the UMD to send BIN_CREDIT_SIZE more bytes of the stream.
+ * The PC grants an initial window and then one more credit for every
+ * BIN_CREDIT_SIZE bytes it consumes, the UMD stops sending when it runs
+ * out of credits so it never overruns the PC. Credits count uncompressed
+ * bytes when BIN_FLAG_RLE is set.
+ */
+
+/*
+ * BIN_OP_PROGSTREAM flow control: the credits go the other way, the UMD
+ * answers the command header with credit bytes (never BIN_SYNC) and every
+ * credit allows the PC to send BIN_CREDIT_SIZE more bytes of payload. The
+ * UMD receives into one half of its buffer while it programs the other,
+ * it grants 2 credits up front and one more every time it is done with a
+ * half, until the whole payload is covered. The response header follows
+ * the last credit once everything is programmed, an error response can
+ * replace the first credit.
+ *
+ * With BIN_FLAG_ERASE the UMD stages the start of the payload in its
+ * serial flash while the erase runs, granting a credit for every block
+ * the serial flash took. Once the erase completes the credits stop while
+ * the staged part is programmed, which can take longer than the erase,
+ * then the rest of the payload follows the regular flow. Without room in
+ * the serial flash the first credit only comes after the erase.
+ */
+
+/*******************************************************************//**
+ * \brief bin_opcode_e
+ * Single byte opcodes, used as the index in the dispatch table so they
+ * must stay contiguous
+ **********************************************************************/
+enum bin_opcode_e : uint8_t
+{
+    BIN_OP_PING = 0,        /**< no operation, answers with an empty response */
+    BIN_OP_SETMODE,         /**< address = umdv1::console_e */
+    BIN_OP_GETID,           /**< query the flash, payload = bin_flashid_t */
+    BIN_OP_ROMSIZE,         /**< payload = uint32_t rom size from the header */
+    BIN_OP_ERASE,           /**< erase the entire flash, answers when complete or with BIN_ERR_FLASH when it failed or timed out */
+    BIN_OP_READ,            /**< payload = length bytes read from address */
+    BIN_OP_PROGRAM,         /**< program the length bytes of payload following the header at address, see BIN_FLAG_VERIFY */
+    BIN_OP_WRITESRAM,       /**< write the length bytes of payload following the header to the SRAM at address */
+    BIN_OP_EXIT,            /**< leave binary mode */
+    BIN_OP_STREAM,          /**< like BIN_OP_READ for any 32bit length, paced by credits from the PC */
+    BIN_OP_HASH,            /**< read length bytes (0 = rom size) without sending them, payload = bin_hash_t */
+    BIN_OP_VERIFY,          /**< compare length bytes at address with the uint32_t CRC-32 per BIN_VERIFY_BLOCK_SIZE of payload, payload = mismatch bitmap */
+    BIN_OP_BLANK,           /**< check length bytes (0 = flash size) at address are 0xFF, payload = uint32_t first other address or 0xFFFFFFFF, address when the flash size is unknown */
+    BIN_OP_ERASERANGE,      /**< erase the sectors covering length bytes at address (the whole flash if its sectors are unknown), answers when complete */
+    BIN_OP_PROGSTREAM,      /**< like BIN_OP_PROGRAM for any 32bit length, the payload is paced by credits from the UMD, answers when complete */
+    BIN_OP_COUNT
+};
+
+/*******************************************************************//**
+ * \brief bin_flags_e
+ * Command flags
+ **********************************************************************/
+enum bin_flags_e : uint8_t
+{
+    BIN_FLAG_SRAM = 0x01,   /**< BIN_OP_READ, BIN_OP_STREAM, BIN_OP_HASH and BIN_OP_VERIFY read the SRAM instead of the ROM */
+    BIN_FLAG_RLE = 0x02,    /**< BIN_OP_READ and BIN_OP_STREAM payload is compressed, see bin_rle_e */
+    BIN_FLAG_CRC = 0x04,    /**< BIN_OP_READ and BIN_OP_STREAM payload is followed by the uint32_t CRC-32 of the uncompressed data */
+    BIN_FLAG_VERIFY = 0x08, /**< BIN_OP_PROGRAM payload = uint32_t count of bytes/words that read back wrong followed by up to BIN_PROGRAM_MAX_FAILS of their uint32_t addresses */
+    BIN_FLAG_ERASE = 0x10   /**< BIN_OP_PROGSTREAM erases the range first like BIN_OP_ERASERANGE and takes the payload during the erase */
+};
+
+/*******************************************************************//**
+ * \brief bin_rle_e
+ * Tokens of a compressed read payload or bin_image_t. The data is cut in stages of
+ * BIN_RLE_STAGE_SIZE bytes, only the last stage can be shorter. Every
+ * token is followed by a stage count and covers that many stages, the
+ * response header length is still the uncompressed length.
+ **********************************************************************/
+enum bin_rle_e : uint8_t
+{
+    BIN_RLE_LITERAL = 0,    /**< count is 1, followed by the raw stage */
+    BIN_RLE_FILL,           /**< followed by one byte, every byte of count stages has that value */
+    BIN_RLE_REPEAT          /**< count stages identical to the previous stage */
+};
+
+/*******************************************************************//**
+ * \brief bin_status_e
+ * Response status codes
+ **********************************************************************/
+enum bin_status_e : uint8_t
+{
+    BIN_OK = 0,             /**< command completed */
+    BIN_ERR_OPCODE,         /**< unknown opcode */
+    BIN_ERR_LENGTH,         /**< length is out of range for this command */
+    BIN_ERR_MODE,           /**< invalid mode or mode not set */
+    BIN_ERR_TIMEOUT,        /**< header or payload did not arrive in time */
+    BIN_ERR_FLASH           /**< the flash reported a failed program or timed out */
+};
+
+/*******************************************************************//**
+ * \brief bin_header_t
+ * Command header sent by the PC, 12 bytes little endian
+ **********************************************************************/
+struct __attribute__((packed)) bin_header_t {
+    uint8_t sync;           /**< always BIN_SYNC */
+    uint8_t opcode;         /**< bin_opcode_e */
+    uint8_t flags;          /**< bin_flags_e */
+    uint8_t seq;            /**< sequence number, echoed in the response */
+    uint32_t address;
+    uint32_t length;
+};
+
+/*******************************************************************//**
+ * \brief bin_response_t
+ * Response header sent by the UMD, 8 bytes little endian, followed by
+ * length bytes of payload
+ **********************************************************************/
+struct __attribute__((packed)) bin_response_t {
+    uint8_t sync;           /**< always BIN_SYNC */
+    uint8_t opcode;         /**< opcode being answered */
+    uint8_t status;         /**< bin_status_e */
+    uint8_t seq;            /**< sequence number of the command */
+    uint32_t length;        /**< payload length */
+};
+
+/*******************************************************************//**
+ * \brief bin_flashid_t
+ * BIN_OP_GETID payload
+ **********************************************************************/
+struct __attribute__((packed)) bin_flashid_t {
+    uint8_t manufacturer;
+    uint8_t device;
+    uint8_t type;
+    uint8_t buffermode;
+    uint32_t size;
+};
+
+/*******************************************************************//**
+ * \brief bin_hash_t
+ * BIN_OP_HASH payload, the console checksums are only calculated for the
+ * ROM and are 0 for consoles without one
+ **********************************************************************/
+struct __attribute__((packed)) bin_hash_t {
+    uint32_t crc32;         /**< CRC-32 of the range, same as the CRC of the dumped file */
+    uint32_t length;        /**< bytes covered by crc32 */
+    uint16_t calculated;    /**< umdv1::calcChecksum() calculated value */
+    uint16_t expected;      /**< umdv1::calcChecksum() value from the header */
+};
+
+/*******************************************************************//**
+ * \brief bin_image_t
+ * Header of a compressed image file in the serial flash, followed by the
+ * bin_rle_e tokens of length bytes. A file without it is a raw image.
+ **********************************************************************/
+struct __attribute__((packed)) bin_image_t {
+    uint32_t magic;         /**< always BIN_IMAGE_MAGIC */
+    uint32_t length;        /**< uncompressed bytes */
+};
+
+#endif
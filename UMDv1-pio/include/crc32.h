@@ -0,0 +1,50 @@
+/*******************************************************************//**
+ *  \file crc32.h
+ *  \author René Richard
+ *  \brief CRC-32 (IEEE 802.3, the one used by zip and the ROM dat files)
+ *         computed on the UMD so a dump can be identified without
+ *         sending it to the PC.
+ *
+ * \copyright This file is part of Universal Mega Dumper.
+ *
+ *   Universal Mega Dumper is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Universal Mega Dumper is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Universal Mega Dumper.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef crc32_h
+#define crc32_h
+
+#include <stdint.h>
+
+#define CRC32_INIT              0xFFFFFFFF  ///< running value to start a CRC with
+
+/*******************************************************************//**
+ * \brief Add bytes to a running CRC-32
+ * \param crc running value, CRC32_INIT for the first block
+ * \param buf bytes to add
+ * \param count number of bytes
+ * \return the running value
+ **********************************************************************/
+uint32_t crc32Update(uint32_t crc, const uint8_t *buf, uint16_t count);
+
+/*******************************************************************//**
+ * \brief Turn a running CRC-32 into the final CRC-32
+ * \param crc running value
+ * \return the CRC-32
+ **********************************************************************/
+inline uint32_t crc32Final(uint32_t crc)
+{
+    return ~crc;
+}
+
+#endif
@@ -60,9 +60,47 @@ class genesis: public umdv1
         /*******************************************************************//**
          * \brief Erase the entire Flash IC
          * \param wait specify whether to wait for the operation to complete
+         * \return STATUS_OK, or the waitChipErase() error when waiting
+         **********************************************************************/
+        virtual status_e eraseChip(bool wait);
+        
+        /*******************************************************************//**
+         * \brief Erase the sector of the Flash IC holding an address
+         * \param address 24bit address within the sector
+         * \param wait specify whether to wait for the operation to complete before returning
+         * \return STATUS_OK, or the pollWord() error when waiting
+         **********************************************************************/
+        virtual status_e eraseSector(uint32_t address, bool wait);
+        
+        /*******************************************************************//**
+         * \brief Read a word from a linear address, see mapBank()
+         * \param address linear address
+         * \return word from cartridge, little endian
+         **********************************************************************/
+        virtual uint16_t readWord(uint32_t address);
+        
+        /*******************************************************************//**
+         * \brief Read consecutive words from a linear address, see mapBank()
+         * \param address linear start address
+         * \param buf destination buffer
+         * \param count number of words to read
+         * \return void
+         **********************************************************************/
+        virtual void readWordBurst(uint32_t address, uint16_t *buf, uint16_t count);
+        
+        /*******************************************************************//**
+         * \brief Write a word to a linear address, see mapBank()
+         * \param address linear address
+         * \param data word
+         * \return void
+         **********************************************************************/
+        virtual void writeWord(uint32_t address, uint16_t data);
+        
+        /*******************************************************************//**
+         * \brief Map every slot back to its own bank, see mapBank()
          * \return void
          **********************************************************************/
-        virtual void eraseChip(bool wait);
+        virtual void restoreBanks();
         
         /*******************************************************************//**
          * \brief Write a byte to a 24bit address on the odd byte
@@ -80,7 +118,26 @@ class genesis: public umdv1
          **********************************************************************/
         void writeByteTime(uint32_t address, uint8_t data);
         
-        void programWordBuffer(uint32_t address, uint16_t * buf, uint8_t size);
+        /*******************************************************************//**
+         * \brief Program words with the S29GL write buffer
+         * \param address 24bit address
+         * \param buf words to program
+         * \param count number of words, they must all fall in the same write buffer
+         * \return STATUS_OK, or the pollWord() error
+         **********************************************************************/
+        virtual status_e programWordBuffer(uint32_t address, uint16_t *buf, uint16_t count);
+        
+        /*******************************************************************//**
+         * \brief Enter the unlock bypass mode of the Flash IC in word mode
+         * \return void
+         **********************************************************************/
+        virtual void enterBypass();
+        
+        /*******************************************************************//**
+         * \brief Leave the unlock bypass mode in word mode
+         * \return void
+         **********************************************************************/
+        virtual void exitBypass();
 
         /*******************************************************************//**
          * \brief Read a word without converting to littel endian
@@ -103,8 +160,35 @@ class genesis: public umdv1
          **********************************************************************/
         virtual void disableSram(uint8_t param);
         
+    protected:
+    
+        /*******************************************************************//**
+         * \brief Write a command to the Flash IC at a CFI offset in word mode
+         * \param offset CFI word offset
+         * \param data command
+         * \return void
+         **********************************************************************/
+        virtual void writeCFI(uint8_t offset, uint8_t data);
+        
+        /*******************************************************************//**
+         * \brief Read a CFI query byte in word mode
+         * \param offset CFI word offset
+         * \return the query byte
+         **********************************************************************/
+        virtual uint8_t readCFI(uint8_t offset);
+        
     private:
     
+        static const uint32_t GEN_BANK_SIZE = 0x80000;          ///< Sega mapper bank and slot size
+        static const uint8_t GEN_BANK_SLOTS = 8;                ///< slots in the 4MB address space, slot 0 is fixed to bank 0
+        static const uint8_t GEN_BANK_SWAP_SLOT = 7;            ///< slot remapped to reach a bank that isn't mapped
+        static const uint32_t GEN_BANK_REG_ADDR = 0xA130F1;     ///< slot n register is at GEN_BANK_REG_ADDR + 2n, 0xA130F3 - 0xA130FF
+        
+        uint8_t bankRegs[GEN_BANK_SLOTS];                       ///< bank held by each slot register
+        uint8_t banksMapped = 0;                                ///< bit n set when mapBank() remapped slot n
+        
+        uint32_t mapBank(uint32_t address);
+    
         //Genesis pin functions
         static const uint8_t GEN_SL1 = 38;
         static const uint8_t GEN_SR1 = 39;
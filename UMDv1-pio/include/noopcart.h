@@ -58,9 +58,17 @@ class noopcart : public umdv1
         /*******************************************************************//**
          * \brief Erase the entire Flash IC
          * \param wait specify whether to wait for the operation to complete before returning
-         * \return void
+         * \return STATUS_OK
+         **********************************************************************/
+        virtual status_e eraseChip(bool wait){ return STATUS_OK; }
+        
+        /*******************************************************************//**
+         * \brief Erase the sector of the Flash IC holding an address
+         * \param address 24bit address within the sector
+         * \param wait specify whether to wait for the operation to complete before returning
+         * \return STATUS_OK
          **********************************************************************/
-        virtual void eraseChip(bool wait){}
+        virtual status_e eraseSector(uint32_t address, bool wait){return STATUS_OK;}
         
         /*******************************************************************//**
          * \brief Perform toggle bit algorithm byte mode
@@ -124,6 +132,24 @@ class noopcart : public umdv1
          * \return word from cartridge
          **********************************************************************/
         virtual uint16_t readWord(uint32_t address){return 0;}
+
+        /*******************************************************************//**
+         * \brief Read consecutive bytes from a 24bit address into a buffer
+         * \param address 24bit start address
+         * \param buf destination buffer
+         * \param count number of bytes to read
+         * \return void
+         **********************************************************************/
+        virtual void readByteBurst(uint32_t address, uint8_t *buf, uint16_t count){ while( count-- ){ *(buf++) = 0; } }
+
+        /*******************************************************************//**
+         * \brief Read consecutive words from a 24bit address into a buffer
+         * \param address 24bit start address
+         * \param buf destination buffer
+         * \param count number of words to read
+         * \return void
+         **********************************************************************/
+        virtual void readWordBurst(uint32_t address, uint16_t *buf, uint16_t count){ while( count-- ){ *(buf++) = 0; } }
         
         /**@}*/
         
@@ -172,19 +198,31 @@ class noopcart : public umdv1
          * \brief Program a byte in the Flash IC
          * \param address 24bit address
          * \param data byte
-         * \param wait Wait for completion using toggle bit to return from function
-         * \return void
+         * \param wait Wait for completion using data polling to return from function
+         * \return STATUS_OK
          **********************************************************************/
-        virtual void programByte(uint32_t address, uint8_t data, bool wait){}
+        virtual status_e programByte(uint32_t address, uint8_t data, bool wait){return STATUS_OK;}
         
         /*******************************************************************//**
          * \brief Program a word in the Flash IC
          * \param address 24bit address
          * \param data word
-         * \param wait Wait for completion using toggle bit to return from function
+         * \param wait Wait for completion using data polling to return from function
+         * \return STATUS_OK
+         **********************************************************************/
+        virtual status_e programWord(uint32_t address, uint16_t data, bool wait){return STATUS_OK;}
+        
+        /*******************************************************************//**
+         * \brief Enter the unlock bypass mode of the Flash IC
+         * \return void
+         **********************************************************************/
+        virtual void enterBypass(){}
+        
+        /*******************************************************************//**
+         * \brief Leave the unlock bypass mode
          * \return void
          **********************************************************************/
-        virtual void programWord(uint32_t address, uint16_t data, bool wait){}
+        virtual void exitBypass(){}
     
         /**@}*/
         
@@ -60,9 +60,17 @@ class sms: public umdv1
         /*******************************************************************//**
          * \brief Erase the entire Flash IC
          * \param wait specify whether to wait for the operation to complete before returning
-         * \return void
+         * \return STATUS_OK, or the waitChipErase() error when waiting
+         **********************************************************************/
+        virtual status_e eraseChip(bool wait);
+        
+        /*******************************************************************//**
+         * \brief Erase the sector of the Flash IC holding an address
+         * \param address 24bit address within the sector
+         * \param wait specify whether to wait for the operation to complete before returning
+         * \return STATUS_OK, or the pollByte() error when waiting
          **********************************************************************/
-        virtual void eraseChip(bool wait);
+        virtual status_e eraseSector(uint32_t address, bool wait);
 
         /*******************************************************************//**
          * \brief Read a byte from a 24bit address using mapper
@@ -71,6 +79,15 @@ class sms: public umdv1
          **********************************************************************/
         virtual uint8_t readByte(uint32_t address);
 
+        /*******************************************************************//**
+         * \brief Read consecutive bytes from a 24bit address using mapper
+         * \param address 24bit start address
+         * \param buf destination buffer
+         * \param count number of bytes to read
+         * \return void
+         **********************************************************************/
+        virtual void readByteBurst(uint32_t address, uint8_t *buf, uint16_t count);
+
         /*******************************************************************//**
          * \brief Write a byte to a 24bit address
          * \param address 24bit address
@@ -79,14 +96,46 @@ class sms: public umdv1
          **********************************************************************/
         virtual void writeByte(uint32_t address, uint8_t data);
 
+        /*******************************************************************//**
+         * \brief Write consecutive bytes to a 24bit address using mapper
+         * \param address 24bit start address
+         * \param buf source buffer
+         * \param count number of bytes to write
+         * \return void
+         **********************************************************************/
+        virtual void writeByteBurst(uint32_t address, uint8_t *buf, uint16_t count);
+
         /*******************************************************************//**
          * \brief Program a byte in the Flash IC
          * \param address 24bit address
          * \param data byte
-         * \param wait Wait for completion using toggle bit to return from function
+         * \param wait Wait for completion using data polling to return from function
+         * \return STATUS_OK, or the pollByte() error when waiting
+         **********************************************************************/
+        virtual status_e programByte(uint32_t address, uint8_t data, bool wait);
+        
+        /*******************************************************************//**
+         * \brief Program consecutive bytes in the Flash IC with ROM writes
+         *        enabled once for the whole block, 0xFF bytes are left erased
+         * \param address 24bit start address
+         * \param buf bytes to program
+         * \param count number of bytes
+         * \return STATUS_OK, the pollByte() error of the first byte that failed or
+         *         STATUS_VERIFY if a byte read back wrong
+         **********************************************************************/
+        virtual status_e programByteBuffer(uint32_t address, uint8_t *buf, uint16_t count);
+        
+        /*******************************************************************//**
+         * \brief Enter the unlock bypass mode of the Flash IC
+         * \return void
+         **********************************************************************/
+        virtual void enterBypass();
+        
+        /*******************************************************************//**
+         * \brief Leave the unlock bypass mode
          * \return void
          **********************************************************************/
-        virtual void programByte(uint32_t address, uint8_t data, bool wait);
+        virtual void exitBypass();
 
         /*******************************************************************//**
          * \brief set the SMS slot register value
@@ -96,6 +145,15 @@ class sms: public umdv1
          **********************************************************************/
         uint16_t setSMSSlotRegister(uint8_t slotNum, uint32_t address);
         
+        /*******************************************************************//**
+         * \brief Read bytes from a single 16KB page, selecting it in slot 2 once
+         * \param address 24bit address
+         * \param buf destination
+         * \param count number of bytes, must not cross a 16KB page
+         * \return void
+         **********************************************************************/
+        void readBank(uint32_t address, uint8_t *buf, uint16_t count);
+        
         /*******************************************************************//**
          * \brief Enable reading and writing to the SRAM
          * \param param none for SMS
@@ -122,10 +180,18 @@ class sms: public umdv1
         static const uint16_t SMS_SLOT_0_REG_ADDR = 0xFFFD; ///< SMS Sega Mapper slot 0 register address 0x0000 - 0x3FFF
         static const uint16_t SMS_SLOT_1_REG_ADDR = 0xFFFE; ///< SMS Sega Mapper slot 1 register address 0x4000 - 0x7FFF
         static const uint16_t SMS_SLOT_2_REG_ADDR = 0xFFFF; ///< SMS Sega Mapper slot 2 register address 0x8000 - 0xBFFF
+        static const uint8_t SMS_CONF_SRAM = 0x88;          ///< conf register value mapping the SRAM in slot 2
+        static const uint8_t SMS_CONF_SRAM_BANK = 0x04;     ///< conf register bit selecting the second 16KB SRAM bank
         
-        uint8_t SMS_SelectedPage = 0xFF;
+        uint16_t SMS_SelectedPage = 0xFFFF; ///< page held by the slot 2 register, 0xFFFF when unknown
+        uint8_t SMS_SramConf = 0;           ///< conf register value while the SRAM is enabled, 0 when disabled
     
         uint32_t skipChecksumStart, skipChecksumEnd;
+        
+        void sumRange(uint32_t start, uint32_t end);
+        uint16_t sumBank(uint32_t address, uint16_t count);
+        inline uint8_t readSlot(uint16_t virtualAddress);
+        uint16_t mapAddress(uint32_t address);
     
         //Master System pin functions
         static const uint8_t SMS_nRST = 42;
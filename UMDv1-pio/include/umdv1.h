@@ -24,6 +24,8 @@
 #ifndef umdv1_h
 #define umdv1_h
 
+#include <stddef.h>
+
 #define DATAOUTH        PORTD     /**< PORTD used for high byte of databus output */
 #define DATAOUTL        PORTC     /**< PORTC used for low byte of databus output */
 #define PORTALE         PORTB     /**< PORTB used for address latch control */
@@ -35,6 +37,13 @@
 #define DATAH_DDR       DDRD      /**< DDRD data direction for high byte of databus */
 #define DATAL_DDR       DDRC      /**< DDRC data direction for low byte of databus */
 
+#define CFI_MAX_REGIONS 4         /**< erase block regions kept from the CFI query */
+
+#define PROGRAM_TIMEOUT         2000    /**< us, single byte/word program timeout when CFI doesn't give one */
+#define BUFFER_TIMEOUT          10000   /**< us, write buffer program timeout when CFI doesn't give one */
+#define SECTOR_ERASE_TIMEOUT    10000   /**< ms, sector erase timeout when CFI doesn't give one */
+#define CHIP_ERASE_TIMEOUT      256000  /**< ms, chip erase timeout when CFI doesn't give one */
+
 // setting DATAOUTx to all 1's fixes the S29GL032 reading problem, this activates the pull-up resistors
 #define SET_DATABUS_TO_INPUT() 	\
 	DATAH_DDR = 0x00;			\
@@ -71,6 +80,18 @@ class umdv1
             TG16                    /**< TG-16 mode */
         };
         static const uint8_t CARTS_LEN = 6;
+        
+		/*******************************************************************//**
+         * \brief status_e
+         * Result of waiting for a program or erase operation of the Flash IC
+         **********************************************************************/
+        enum status_e : uint8_t
+        {
+            STATUS_OK = 0,          /**< the operation completed */
+            STATUS_FAIL,            /**< the Flash IC set DQ5, the operation failed */
+            STATUS_TIMEOUT,         /**< the Flash IC was still busy when the timeout expired */
+            STATUS_VERIFY           /**< the operation completed but the data read back is different */
+        };
 
 		struct s_info {
 			uint8_t bus_size;
@@ -88,7 +109,19 @@ class umdv1
             uint8_t type;
             uint32_t size;
             uint8_t buffermode;     /**< buffermode = 0 single write, buffermode = 1 buffered write */
-        } flashID;
+            uint16_t bufferSize;    /**< write buffer size in bytes when buffermode = 1, buffers are aligned on their size */
+            bool bypass;            /**< the flash supports the unlock bypass program mode */
+            bool cfi;               /**< the fields below were read with a CFI query */
+            uint16_t programTimeout;        /**< max single byte/word program time in us, 0 when unknown */
+            uint16_t bufferTimeout;         /**< max write buffer program time in us, 0 when unknown */
+            uint16_t sectorEraseTimeout;    /**< max sector erase time in ms, 0 when unknown */
+            uint32_t chipEraseTimeout;      /**< max chip erase time in ms up to 2^22, 0 when unknown */
+            uint8_t regions;        /**< number of erase block regions, from the bottom of the array up */
+            struct {
+                uint16_t count;     /**< number of sectors in the region */
+                uint32_t size;      /**< sector size in bytes */
+            } region[CFI_MAX_REGIONS];
+        } flashID = {};
     
 		/*******************************************************************//**
          * \brief s_checksum
@@ -99,6 +132,10 @@ class umdv1
 			uint16_t calculated;
 			uint32_t romSize;
 		} checksum;
+
+        bool quiet = false;                                 ///< don't print the "." keep alive while calculating the checksum
+
+        void (*pollIdle)() = NULL;                          ///< called while pollByte()/pollWord() wait on the Flash IC, must not touch the cartridge bus
     
         /*******************************************************************//**
          * \brief Constructor
@@ -129,9 +166,25 @@ class umdv1
         /*******************************************************************//**
          * \brief Erase the entire Flash IC
          * \param wait specify whether to wait for the operation to complete before returning
-         * \return void
+         * \return STATUS_OK, or the waitChipErase() error when waiting
          **********************************************************************/
-        virtual void eraseChip(bool wait);
+        virtual status_e eraseChip(bool wait);
+        
+        /*******************************************************************//**
+         * \brief Erase the sector of the Flash IC holding an address
+         * \param address 24bit address within the sector
+         * \param wait specify whether to wait for the operation to complete before returning
+         * \return STATUS_OK, or the pollByte() error when waiting
+         **********************************************************************/
+        virtual status_e eraseSector(uint32_t address, bool wait);
+        
+        /*******************************************************************//**
+         * \brief Get the size of the sector holding an address, getFlashID()
+         *        must be called first
+         * \param address 24bit address within the sector
+         * \return the sector size in bytes, 0 if the sector map of the Flash IC is unknown
+         **********************************************************************/
+        uint32_t getSectorSize(uint32_t address);
         
         /*******************************************************************//**
          * \brief Perform toggle bit algorithm byte mode
@@ -146,6 +199,28 @@ class umdv1
          * \return the number of times the bit successfully toggled
          **********************************************************************/
         uint8_t toggleBit16(uint8_t attempts);
+        
+        /*******************************************************************//**
+         * \brief Wait for a program or erase operation with DQ7 data polling
+         *        in byte mode, the address is only latched once
+         * \param address 24bit address being programmed, or within the sector being erased
+         * \param data byte being programmed, 0xFF for an erase
+         * \param timeout give up after this many us
+         * \return STATUS_OK, STATUS_FAIL after resetting the Flash IC, STATUS_TIMEOUT
+         *         or STATUS_VERIFY
+         **********************************************************************/
+        status_e pollByte(uint32_t address, uint8_t data, uint32_t timeout);
+        
+        /*******************************************************************//**
+         * \brief Wait for a program or erase operation with DQ7 data polling
+         *        in word mode, the address is only latched once
+         * \param address 24bit address being programmed, or within the sector being erased
+         * \param data word being programmed, 0xFFFF for an erase
+         * \param timeout give up after this many us
+         * \return STATUS_OK, STATUS_FAIL after resetting the Flash IC, STATUS_TIMEOUT
+         *         or STATUS_VERIFY
+         **********************************************************************/
+        status_e pollWord(uint32_t address, uint16_t data, uint32_t timeout);
 
 
 		/*******************************************************************//**
@@ -208,7 +283,25 @@ class umdv1
          * \return word from cartridge
          **********************************************************************/
         virtual uint16_t readWord(uint32_t address);
-        
+
+        /*******************************************************************//**
+         * \brief Read consecutive bytes from a 24bit address into a buffer
+         * \param address 24bit start address
+         * \param buf destination buffer
+         * \param count number of bytes to read
+         * \return void
+         **********************************************************************/
+        virtual void readByteBurst(uint32_t address, uint8_t *buf, uint16_t count);
+
+        /*******************************************************************//**
+         * \brief Read consecutive words from a 24bit address into a buffer
+         * \param address 24bit start address
+         * \param buf destination buffer
+         * \param count number of words to read
+         * \return void
+         **********************************************************************/
+        virtual void readWordBurst(uint32_t address, uint16_t *buf, uint16_t count);
+
         /**@}*/
         
         
@@ -233,6 +326,15 @@ class umdv1
          * \return void
          **********************************************************************/
         virtual void writeByte(uint32_t address, uint8_t data);
+        
+        /*******************************************************************//**
+         * \brief Write consecutive bytes from a buffer to a 24bit address
+         * \param address 24bit start address
+         * \param buf source buffer
+         * \param count number of bytes to write
+         * \return void
+         **********************************************************************/
+        virtual void writeByteBurst(uint32_t address, uint8_t *buf, uint16_t count);
 
         virtual void writeByteTime(uint32_t address, uint8_t data);
         
@@ -264,19 +366,62 @@ class umdv1
          * \brief Program a byte in the Flash IC
          * \param address 24bit address
          * \param data byte
-         * \param wait Wait for completion using toggle bit to return from function
-         * \return void
+         * \param wait Wait for completion using data polling to return from function
+         * \return STATUS_OK, or the pollByte() error when waiting
          **********************************************************************/
-        virtual void programByte(uint32_t address, uint8_t data, bool wait);
+        virtual status_e programByte(uint32_t address, uint8_t data, bool wait);
         
         /*******************************************************************//**
          * \brief Program a word in the Flash IC
          * \param address 24bit address
          * \param data word
-         * \param wait Wait for completion using toggle bit to return from function
+         * \param wait Wait for completion using data polling to return from function
+         * \return STATUS_OK, or the pollWord() error when waiting
+         **********************************************************************/
+        virtual status_e programWord(uint32_t address, uint16_t data, bool wait);
+        
+        /*******************************************************************//**
+         * \brief Program words with the Flash IC write buffer, the base
+         *        class programs them one at a time
+         * \param address 24bit address
+         * \param buf words to program
+         * \param count number of words, they must all fall in the same write buffer
+         * \return STATUS_OK, the pollWord() error of the first word that failed or
+         *         STATUS_VERIFY if a word read back wrong
+         **********************************************************************/
+        virtual status_e programWordBuffer(uint32_t address, uint16_t *buf, uint16_t count);
+        
+        /*******************************************************************//**
+         * \brief Program consecutive bytes in the Flash IC, 0xFF bytes are
+         *        left erased
+         * \param address 24bit start address
+         * \param buf bytes to program
+         * \param count number of bytes
+         * \return STATUS_OK, the pollByte() error of the first byte that failed or
+         *         STATUS_VERIFY if a byte read back wrong
+         **********************************************************************/
+        virtual status_e programByteBuffer(uint32_t address, uint8_t *buf, uint16_t count);
+        
+        /*******************************************************************//**
+         * \brief Enter the unlock bypass mode of the Flash IC when it has one,
+         *        programByte() and programWord() then skip the unlock cycles
+         *        until exitBypass() is called
          * \return void
          **********************************************************************/
-        virtual void programWord(uint32_t address, uint16_t data, bool wait);
+        virtual void enterBypass();
+        
+        /*******************************************************************//**
+         * \brief Leave the unlock bypass mode, does nothing if it isn't active
+         * \return void
+         **********************************************************************/
+        virtual void exitBypass();
+        
+        /*******************************************************************//**
+         * \brief Put back the bank mapping the cartridge powers up with after
+         *        a command mapped other banks, does nothing without a mapper
+         * \return void
+         **********************************************************************/
+        virtual void restoreBanks();
     
         /**@}*/
         
@@ -326,7 +471,39 @@ class umdv1
         static const uint8_t SCSp = 20;
     
         uint8_t _resetPin;
-    
+
+        uint8_t _latchedHigh;                               ///< address bits 23..16 currently held in the high latch
+        bool _latchedHighValid = false;                     ///< false when the high latch content is unknown
+
+        bool _bypass = false;                               ///< the Flash IC is in unlock bypass mode
+
+        /*******************************************************************//**
+         * \brief Strobe nCE and nRD to read a byte at the address already latched
+         * \return byte from cartridge
+         **********************************************************************/
+        uint8_t readLatchedByte();
+        
+        /*******************************************************************//**
+         * \brief Strobe nCE and nRD to read a word at the address already latched
+         * \return word from cartridge, converted like readWord()
+         **********************************************************************/
+        uint16_t readLatchedWord();
+        
+        /*******************************************************************//**
+         * \brief Wait for a chip erase with data polling at address 0, printing
+         *        a "." every 250ms and a "!" when done
+         * \return STATUS_OK, or the pollByte()/pollWord() error after the CFI
+         *         chip erase timeout or CHIP_ERASE_TIMEOUT
+         **********************************************************************/
+        status_e waitChipErase();
+        
+        /*******************************************************************//**
+         * \brief pollIdle of waitChipErase(), flashes the LED and prints the
+         *        "." the PC side app expects before it times out
+         * \return void
+         **********************************************************************/
+        static void chipEraseProgress();
+
     	/*******************************************************************//**
          * \brief latch a 16bit address
          * \return void
@@ -346,6 +523,28 @@ class umdv1
          * \return size the size of the flash in bytes
          **********************************************************************/
         uint32_t getFlashSizeFromID(uint8_t manufacturer, uint8_t device);
+        
+        /*******************************************************************//**
+         * \brief Run a Common Flash Interface query, fills the size, write
+         *        buffer, timeout and erase region fields of flashID
+         * \return true if the Flash IC answered the query
+         **********************************************************************/
+        bool queryCFI();
+        
+        /*******************************************************************//**
+         * \brief Write a command to the Flash IC at a CFI offset
+         * \param offset CFI word offset
+         * \param data command
+         * \return void
+         **********************************************************************/
+        virtual void writeCFI(uint8_t offset, uint8_t data);
+        
+        /*******************************************************************//**
+         * \brief Read a CFI query byte
+         * \param offset CFI word offset
+         * \return the query byte
+         **********************************************************************/
+        virtual uint8_t readCFI(uint8_t offset);
     
     
     private:
@@ -27,6 +27,12 @@
  **********************************************************************/
 genesis::genesis() 
 {
+    // every slot holds its own bank at power up, or the cart has no mapper
+    for( uint8_t slot = 0; slot < GEN_BANK_SLOTS; slot++ )
+    {
+        bankRegs[slot] = slot;
+    }
+    banksMapped = 0;
 }
 
 /*******************************************************************//**
@@ -53,6 +59,9 @@ void genesis::setup(uint8_t param)
     info.mirrored_bus = false;
     info.bus_size = 16;
     
+    // put back the slots an earlier session remapped
+    restoreBanks();
+    
     _resetPin = GEN_nVRES;
     //resetCart();   
 }
@@ -72,6 +81,7 @@ void genesis::getFlashID(void)
     flashID.type = 0;
     flashID.size = 0;
     flashID.buffermode = 0;
+    flashID.bufferSize = 0;
 
     // enter software ID mode
     writeWord( (uint32_t)(0x000555 << 1), 0xAA00);
@@ -83,16 +93,49 @@ void genesis::getFlashID(void)
     // read device
     readData = readWord( (uint32_t)(0x000001 << 1) );
     flashID.device = (uint8_t)(readData >> 8);
+    // spansion S29GL parts have an extended device ID
+    if( flashID.device == 0x7E )
+    {
+        readData = readWord( (uint32_t)(0x00000E << 1) );
+        flashID.type = (uint8_t)(readData >> 8);
+    }
     // exit software ID mode
     writeWord( (uint32_t)0x000000, 0xF000);
+
+    // the CFI query gives the size and write buffer
+    if( queryCFI() )
+    {
+        return;
+    }
+
     // figure out the size
     flashID.size = getFlashSizeFromID( flashID.manufacturer, flashID.device );
 
+    // spansion S29GL, the N parts have a 16 word write buffer, the later
+    // ones more, 16 words fall within any of them
     if(flashID.manufacturer == 0x01){
         flashID.buffermode = 1;
+        flashID.bufferSize = 32;
     }
 }
 
+/*******************************************************************//**
+ * The writeCFI() function writes a command at a CFI offset, commands
+ * go on the high byte like every other genesis flash command
+ **********************************************************************/
+void genesis::writeCFI(uint8_t offset, uint8_t data)
+{
+    writeWord( (uint32_t)offset << 1, (uint16_t)data << 8 );
+}
+
+/*******************************************************************//**
+ * The readCFI() function reads a CFI query byte from the high byte
+ **********************************************************************/
+uint8_t genesis::readCFI(uint8_t offset)
+{
+    return (uint8_t)( readWord( (uint32_t)offset << 1 ) >> 8 );
+}
+
 /*******************************************************************//**
  * The calcChecksum() function calculates the word sum of all words
  * in the Genesis cartridge
@@ -114,7 +157,7 @@ void genesis::calcChecksum()
         address += 2;
         
         //PC side app expects a "." before timeout
-        if( timeOut++ > 0x3FFF )
+        if( !quiet && ( timeOut++ > 0x3FFF ) )
         {
             timeOut = 0;
             Serial.print(".");
@@ -122,39 +165,50 @@ void genesis::calcChecksum()
     }
     
     //Send something other than a "." to indicate we are done
-    Serial.print("!");
+    if( !quiet )
+    {
+        Serial.print("!");
+    }
 }
 
 /*******************************************************************//**
  * The programWordBuffer() function uses the S29GL0xx buffer mode
- * to program a block of words at once
+ * to program a block of words at once, all words must fall within the
+ * same write buffer (flashID.bufferSize aligned)
  **********************************************************************/
-void genesis::programWordBuffer(uint32_t address, uint16_t * buf, uint8_t size)
+genesis::status_e genesis::programWordBuffer(uint32_t address, uint16_t *buf, uint16_t count)
 {
-    uint8_t i;
-    uint32_t sectorAddr, writeAddr;
-
-    // address must full within a 32b/16w boundary
-    sectorAddr = 0xFFFFFFE0 & address;
-    writeAddr = sectorAddr;
+    uint16_t i;
+    status_e status;
 
-    // enter write to buffer mode
+    // enter write to buffer mode, any address within the sector will do
     writeWord( (uint32_t)(0x000555 << 1), 0xAA00);
     writeWord( (uint32_t)(0x0002AA << 1), 0x5500);
-    writeWord( sectorAddr, 0x2500);
-    writeWord( sectorAddr, size-1);
+    writeWord( address, 0x2500);
+    // word count minus 1
+    writeWord( address, count - 1);
 
     // write contents to program flash buffer
-    for(i=0; i<size; i++){
-        writeWord( writeAddr, *(buf++) );
-        writeAddr += 2;
+    for(i=0; i<count; i++){
+        writeWord( address + (i << 1), buf[i] );
     }
 
     // program buffer to flash
-    writeWord( sectorAddr, 0x2900);
+    writeWord( address, 0x2900);
 
-    //use data polling to validate end of program cycle
-    while( toggleBit16(4) != 4 );
+    //use data polling on the last word loaded to validate end of program cycle
+    status = pollWord( address + ( ( count - 1 ) << 1 ), buf[count - 1],
+        flashID.bufferTimeout ? flashID.bufferTimeout : BUFFER_TIMEOUT );
+
+    // a failed or aborted buffer program needs the write to buffer abort reset
+    if( ( status == STATUS_FAIL ) || ( status == STATUS_TIMEOUT ) )
+    {
+        writeWord( (uint32_t)(0x000555 << 1), 0xAA00);
+        writeWord( (uint32_t)(0x0002AA << 1), 0x5500);
+        writeWord( (uint32_t)(0x000555 << 1), 0xF000);
+    }
+
+    return status;
 }
 
 /*******************************************************************//**
@@ -175,10 +229,10 @@ uint32_t genesis::getRomSize()
 
 /*******************************************************************//**
  * The eraseChip() function erases the entire flash. If the wait parameter
- * is true the function will block with toggle bit until the erase 
- * operation has completed.
+ * is true the function will block with waitChipErase() until the erase
+ * operation has completed or timed out.
  **********************************************************************/
-void genesis::eraseChip(bool wait)
+genesis::status_e genesis::eraseChip(bool wait)
 {
 	writeWord( (uint32_t)(0x000555 << 1), 0xAA00);
     writeWord( (uint32_t)(0x0002AA << 1), 0x5500);
@@ -187,28 +241,169 @@ void genesis::eraseChip(bool wait)
     writeWord( (uint32_t)(0x0002AA << 1), 0x5500);
     writeWord( (uint32_t)(0x000555 << 1), 0x1000);
 	
-	// if wait parameter was specified, do toggle until operation is complete
+	// if wait parameter was specified, poll until operation is complete
 	if( wait )
 	{
-		// start a timer
-		uint32_t intervalMillis;
-        intervalMillis = millis();
-        
-        // wait for 4 consecutive toggle bit success reads before exiting
-        while( toggleBit16(4) != 4 )
+        return waitChipErase();
+	}
+
+    return STATUS_OK;
+}
+
+/*******************************************************************//**
+ * The eraseSector() function erases the sector holding address in word
+ * mode. If the wait parameter is true the function will block with
+ * data polling until the erase operation has completed or timed out.
+ **********************************************************************/
+genesis::status_e genesis::eraseSector(uint32_t address, bool wait)
+{
+    writeWord( (uint32_t)(0x000555 << 1), 0xAA00);
+    writeWord( (uint32_t)(0x0002AA << 1), 0x5500);
+    writeWord( (uint32_t)(0x000555 << 1), 0x8000);
+    writeWord( (uint32_t)(0x000555 << 1), 0xAA00);
+    writeWord( (uint32_t)(0x0002AA << 1), 0x5500);
+    writeWord( address, 0x3000);
+
+    if( wait )
+    {
+        return pollWord(address, 0xFFFF, ( flashID.sectorEraseTimeout ? flashID.sectorEraseTimeout : SECTOR_ERASE_TIMEOUT ) * 1000UL);
+    }
+
+    return STATUS_OK;
+}
+
+/*******************************************************************//**
+ * The enterBypass() function puts the flash in unlock bypass mode in
+ * word mode when getFlashID() found it supports it.
+ **********************************************************************/
+void genesis::enterBypass()
+{
+    if( !flashID.bypass || _bypass )
+    {
+        return;
+    }
+
+    writeWord( (uint32_t)(0x000555 << 1), 0xAA00);
+    writeWord( (uint32_t)(0x0002AA << 1), 0x5500);
+    writeWord( (uint32_t)(0x000555 << 1), 0x2000);
+    _bypass = true;
+}
+
+/*******************************************************************//**
+ * The exitBypass() function returns the flash to read array mode from
+ * unlock bypass mode in word mode.
+ **********************************************************************/
+void genesis::exitBypass()
+{
+    if( !_bypass )
+    {
+        return;
+    }
+
+    writeWord( (uint32_t)0x000000, 0x9000);
+    writeWord( (uint32_t)0x000000, 0x0000);
+    _bypass = false;
+}
+
+/*******************************************************************//**
+ * The mapBank function returns the bus address of a linear address. The
+ * Sega mapper splits the 4MB bus in 8 slots of 512KB, slot 0 always
+ * holds bank 0 and the registers at 0xA130F3 - 0xA130FF select the bank
+ * of slots 1 to 7. bankRegs caches the registers, a bank that is already
+ * in a slot is read from there and any other bank is mapped in
+ * GEN_BANK_SWAP_SLOT, so the registers are only written when a read
+ * crosses into a bank that isn't mapped. Nothing is written until an
+ * address above 4MB is accessed, /TIME writes can latch the SRAM on a
+ * cart without a mapper. banksMapped records the remapped slots.
+ **********************************************************************/
+uint32_t genesis::mapBank(uint32_t address)
+{
+    uint8_t bank, slot;
+
+    bank = (uint8_t)( address >> 19 );
+    if( ( bank < GEN_BANK_SLOTS ) && ( bankRegs[bank] == bank ) )
+    {
+        return address;
+    }
+
+    for( slot = 1; slot < GEN_BANK_SLOTS; slot++ )
+    {
+        if( bankRegs[slot] == bank )
         {
-            if( (millis() - intervalMillis) > 250 )
-            {
-                // flash to show progress
-                digitalWrite(nLED, !digitalRead(nLED));
-                //PC side app expects a "." before timeout
-                intervalMillis = millis();
-                Serial.print(".");
-            }
+            break;
         }
-        //Send something other than a "." to indicate we are done
-        Serial.print("!");
-	}
+    }
+
+    if( slot == GEN_BANK_SLOTS )
+    {
+        slot = GEN_BANK_SWAP_SLOT;
+        writeByteTime(GEN_BANK_REG_ADDR + ( slot << 1 ), bank);
+        bankRegs[slot] = bank;
+        banksMapped |= ( 1 << slot );
+    }
+
+    return ( (uint32_t)slot << 19 ) | ( address & ( GEN_BANK_SIZE - 1 ) );
+}
+
+/*******************************************************************//**
+ * The restoreBanks function maps the slots mapBank() remapped back to
+ * their own bank, nothing is written if no slot was remapped.
+ **********************************************************************/
+void genesis::restoreBanks()
+{
+    uint8_t slot;
+
+    for( slot = 1; slot < GEN_BANK_SLOTS; slot++ )
+    {
+        if( banksMapped & ( 1 << slot ) )
+        {
+            writeByteTime(GEN_BANK_REG_ADDR + ( slot << 1 ), slot);
+            bankRegs[slot] = slot;
+        }
+    }
+    banksMapped = 0;
+}
+
+/*******************************************************************//**
+ * The readWord function returns a word read from a linear address
+ * through mapBank(), little endian like umdv1::readWord()
+ **********************************************************************/
+uint16_t genesis::readWord(uint32_t address)
+{
+    return umdv1::readWord(mapBank(address));
+}
+
+/*******************************************************************//**
+ * The readWordBurst function reads count consecutive words starting at
+ * a linear address, one umdv1::readWordBurst() per bank so a single
+ * read can run across any number of banks
+ **********************************************************************/
+void genesis::readWordBurst(uint32_t address, uint16_t *buf, uint16_t count)
+{
+    uint32_t chunk;
+
+    while( count )
+    {
+        chunk = ( GEN_BANK_SIZE - ( address & ( GEN_BANK_SIZE - 1 ) ) ) >> 1;
+        if( chunk > count )
+        {
+            chunk = count;
+        }
+
+        umdv1::readWordBurst(mapBank(address), buf, (uint16_t)chunk);
+        address += ( chunk << 1 );
+        buf += chunk;
+        count -= chunk;
+    }
+}
+
+/*******************************************************************//**
+ * The writeWord function writes a word to a linear address through
+ * mapBank()
+ **********************************************************************/
+void genesis::writeWord(uint32_t address, uint16_t data)
+{
+    umdv1::writeWord(mapBank(address), data);
 }
 
 /*******************************************************************//**
@@ -218,7 +413,7 @@ void genesis::eraseChip(bool wait)
 void genesis::writeByte(uint32_t address, uint8_t data)
 {
 
-    latchAddress32(address);
+    latchAddress32(mapBank(address));
     SET_DATABUS_TO_OUTPUT();
     DATAOUTL = data;
     
@@ -263,7 +458,7 @@ uint16_t genesis::readBigWord(uint32_t address)
 {
     uint16_t readData;
 
-    latchAddress32(address);
+    latchAddress32(mapBank(address));
     SET_DATABUS_TO_INPUT();
 
     // read the bus, setup the direction on the level shifters first to avoid contention
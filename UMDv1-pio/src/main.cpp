@@ -28,8 +28,13 @@
 
 #include "umdv1.h"
 #include "cartfactory.h"
+#include "binproto.h"
+#include "crc32.h"
 
 #define DATA_BUFFER_SIZE            2048    ///< Size of serial receive data buffer
+#define USB_PACKET_SIZE             64      ///< Size of the Teensy USB serial endpoint, DATA_BUFFER_SIZE must be a multiple of it
+#define PIPE_STAGE_SIZE             (2*USB_PACKET_SIZE) ///< Bytes per read pipeline stage, fills both banks of the USB endpoint
+#define BLANK                       0xFFFFFFFF  ///< blankCheck() result when the whole range reads 0xFF
 
 SerialCommand SCmd;                         ///< Receive and parse serial commands
 umdv1 *cart;                                ///< Pointer to all cartridge classes
@@ -45,14 +50,54 @@ union dataBuffer{
     uint16_t    word[DATA_BUFFER_SIZE/2];   ///< word access within dataBuffer
 } dataBuffer;                               ///< union of byte/words to permit the Rx of bytes and Tx of words without hassle
 
+char *pipeStage = dataBuffer.byte;          ///< half of dataBuffer holding the last read pipeline stage
+
+static_assert(PIPE_STAGE_SIZE == BIN_RLE_STAGE_SIZE, "the host decodes the compressed stream in PIPE_STAGE_SIZE stages");
+bool rleEnabled = false;                    ///< compress the read stream, see BIN_FLAG_RLE
+bool rleHavePrev;                           ///< a previous stage is available for BIN_RLE_REPEAT
+uint16_t rlePrevCount;                      ///< size of the previous stage
+uint8_t rleRunType;                         ///< token of the run being accumulated
+uint8_t rleRunCount;                        ///< stages in the run being accumulated, 0 when none
+uint8_t rleRunValue;                        ///< fill value of a BIN_RLE_FILL run
+
+bool crcEnabled = false;                    ///< add the read stream to crcValue, see BIN_FLAG_CRC
+uint32_t crcValue;                          ///< running CRC-32 of the read stream
+
+uint32_t programFails[BIN_PROGRAM_MAX_FAILS];   ///< addresses that read back wrong after programming
+uint32_t programFailCount;                  ///< bytes/words that read back wrong, may exceed BIN_PROGRAM_MAX_FAILS
+
+static_assert(DATA_BUFFER_SIZE == 2*BIN_CREDIT_SIZE, "BIN_OP_PROGSTREAM receives one credit into each half of dataBuffer");
+char *rxHalf;                               ///< half of dataBuffer receiving the next BIN_OP_PROGSTREAM block
+uint16_t rxCount;                           ///< bytes received in rxHalf
+uint16_t rxSize;                            ///< bytes expected in rxHalf
+bool rxMirror;                              ///< reverse the bits of the received bytes
+uint32_t sfSource;                          ///< serial flash address sfPump() reads next into rxHalf
+bool sfCompressed;                          ///< sfPump() expands a compressed image, see bin_image_t
+uint32_t sfLeft;                            ///< bytes of the compressed image sfPump() has yet to expand
+uint8_t sfToken;                            ///< bin_rle_e token being expanded
+uint8_t sfStages;                           ///< stages left in the token, 0 to read the next token
+uint8_t sfStageSize;                        ///< bytes in the stage being expanded
+uint8_t sfStagePos;                         ///< bytes of the stage expanded
+uint8_t sfFill;                             ///< value of a BIN_RLE_FILL token
+char sfStage[BIN_RLE_STAGE_SIZE];           ///< the stage being expanded, still the previous one for BIN_RLE_REPEAT
+
+uint32_t stageBase;                         ///< serial flash address a BIN_FLAG_ERASE upload is staged at
+uint32_t stageWanted;                       ///< bytes to stage, no more credits once stageGranted reaches it
+uint32_t stageGranted;                      ///< bytes the PC was granted credits for while staging
+uint32_t stageCount;                        ///< bytes written to the serial flash
+uint32_t stageErased;                       ///< bytes erased ahead of stageCount from stageBase
+uint32_t stageDirty;                        ///< bytes from stageBase still to erase once the staged upload is programmed
+
 
 void _flashThunder();
 void _setMode();
 void _unknownCMD(const char *command);
 void eraseChip();
+void eraseSectors();
 void readByteBlock();
 void getFlashID();
 void calcChecksum();
+void blankCheckCmd();
 void getRomSize();
 void readWordBlock();
 void writeSRAMByteBlock();
@@ -66,10 +111,79 @@ void sfListFiles();
 void sfReadFile();
 void sfWriteFile();
 void sfVerify();
+void _binaryMode();
 
 void sfEraseCartBurnAuto(uint16_t blockSize);
+void sendByteBlock(uint32_t address, uint32_t size);
+void sendWordBlock(uint32_t address, uint32_t size);
+char *swapPipeStage();
+void sendStage(const char *stage, uint16_t count);
+void rleBegin();
+void rleStage(const char *stage, uint16_t count);
+void rleFlush();
+void rleEnd();
+void crcBegin();
+void crcEnd();
+uint32_t hashBlock(uint32_t address, uint32_t size);
+uint32_t blankCheck(uint32_t address, uint32_t size, bool progress);
+bool eraseRange(uint32_t address, uint32_t size, bool progress);
+void eraseProgress();
+void receiveBlock(uint16_t size, bool mirror);
+void writeSramBlock(uint32_t address, uint16_t size);
+bool burnByteBlock(uint32_t address, uint16_t size, uint8_t *buf);
+bool burnWordBlock(uint32_t address, uint16_t size, uint16_t *buf);
+void programFailed(uint32_t address);
+void rxBegin(char *half, uint16_t size);
+void rxPump();
+void rxFinish();
+uint32_t sfOpen(SerialFlashFile &file);
+void sfPump();
+void sfFinish();
+bool sfBurn(uint32_t address, uint32_t size, uint16_t blockSize, bool progress);
+uint32_t stageOpen(uint32_t size);
+void stagePump();
+bool stageProgram(uint32_t address, uint32_t size);
+void stageClean(bool wait);
 void flash_led(uint8_t times, uint32_t wait);
 
+void binRespond(const bin_header_t *hdr, uint8_t status, uint32_t length);
+void binPing(bin_header_t *hdr);
+void binSetMode(bin_header_t *hdr);
+void binGetID(bin_header_t *hdr);
+void binRomSize(bin_header_t *hdr);
+void binErase(bin_header_t *hdr);
+void binRead(bin_header_t *hdr);
+void binProgram(bin_header_t *hdr);
+void binWriteSram(bin_header_t *hdr);
+void binExit(bin_header_t *hdr);
+void binStream(bin_header_t *hdr);
+void binHash(bin_header_t *hdr);
+void binVerify(bin_header_t *hdr);
+void binBlank(bin_header_t *hdr);
+void binEraseRange(bin_header_t *hdr);
+void binProgramStream(bin_header_t *hdr);
+void binDiscard(uint32_t count);
+
+/// binary protocol dispatch table, indexed by bin_opcode_e
+void (* const binHandlers[BIN_OP_COUNT])(bin_header_t *hdr) = {
+    binPing,                                ///< BIN_OP_PING
+    binSetMode,                             ///< BIN_OP_SETMODE
+    binGetID,                               ///< BIN_OP_GETID
+    binRomSize,                             ///< BIN_OP_ROMSIZE
+    binErase,                               ///< BIN_OP_ERASE
+    binRead,                                ///< BIN_OP_READ
+    binProgram,                             ///< BIN_OP_PROGRAM
+    binWriteSram,                           ///< BIN_OP_WRITESRAM
+    binExit,                                ///< BIN_OP_EXIT
+    binStream,                              ///< BIN_OP_STREAM
+    binHash,                                ///< BIN_OP_HASH
+    binVerify,                              ///< BIN_OP_VERIFY
+    binBlank,                               ///< BIN_OP_BLANK
+    binEraseRange,                          ///< BIN_OP_ERASERANGE
+    binProgramStream                        ///< BIN_OP_PROGSTREAM
+};
+bool binActive = false;                     ///< true while the binary protocol loop runs
+
 /*******************************************************************//**
  *  \brief Flash the LED, initialize the serial flash memory
  *         and register all serial commands.
@@ -97,9 +211,11 @@ void setup() {
     
     //register callbacks for SerialCommand related to the cartridge
     SCmd.addCommand("erase",  eraseChip);
+    SCmd.addCommand("erasesec", eraseSectors);
     SCmd.addCommand("getid",  getFlashID);
     SCmd.addCommand("checksum", calcChecksum);
     SCmd.addCommand("romsize", getRomSize);
+    SCmd.addCommand("blank", blankCheckCmd);
     
     //read commands
     //SCmd.addCommand("rdbyte", readByte);
@@ -127,6 +243,9 @@ void setup() {
     SCmd.addCommand("sflist", sfListFiles);
     SCmd.addCommand("sfverify", sfVerify);
     
+    //switch to the binary framed protocol, see binproto.h
+    SCmd.addCommand("binmode", _binaryMode);
+    
     SCmd.addDefaultHandler(_unknownCMD);
     SCmd.clearBuffer();
 }
@@ -140,11 +259,15 @@ void loop()
     // listen for commands
     SCmd.readSerial();
 
+    // give the serial flash back the blocks of the last staged upload
+    stageClean(false);
+
     // check push button to clr rom and burn auto.bin from serial flash
     if( digitalRead(umdv1::nPB) == LOW ){
         // purpose built for genesis ROM
         cart = cf.getCart(umdv1::GENESIS);
         sfEraseCartBurnAuto(512);
+        cart->restoreBanks();
     }
 }
 
@@ -220,6 +343,8 @@ void _setMode()
  *  
  *  Usage:
  *  erase w
+ *    - waits for the erase, prints "." while busy then "!" and "done" or
+ *      "error" when the flash failed or timed out
  *  
  *  \return Void
  **********************************************************************/
@@ -236,7 +361,13 @@ void eraseChip()
         {
             //wait for operation to complete, measure time
             case 'w':
-                cart->eraseChip(true);
+                if( cart->eraseChip(true) == umdv1::STATUS_OK )
+                {
+                    Serial.println(F("done"));
+                }else
+                {
+                    Serial.println(F("error"));
+                }
                 break;
             default:
                 break;
@@ -248,6 +379,105 @@ void eraseChip()
     digitalWrite(cart->nLED, HIGH);
 }
 
+/*******************************************************************//**
+ *  \brief Check that a range of the flash is erased
+ *  Requires set mode to be issued prior. Without a size the whole flash
+ *  is checked, when its size is unknown the address is returned.
+ *  
+ *  Usage:
+ *  blank 0x0000 0x400000
+ *    - returns "blank" or the address of the first byte that is not 0xFF
+ *  
+ *  \return Void
+ **********************************************************************/
+void blankCheckCmd()
+{
+    char *arg;
+    uint32_t address = 0, size = 0, result;
+
+    arg = SCmd.next();
+    if( arg != NULL )
+    {
+        address = strtoul(arg, (char**)0, 0);
+        arg = SCmd.next();
+        if( arg != NULL )
+        {
+            size = strtoul(arg, (char**)0, 0);
+        }
+    }
+
+    if( size == 0 )
+    {
+        cart->getFlashID();
+        size = cart->flashID.size;
+    }
+
+    // never call a range nobody checked blank, the PC erases the chip
+    if( size == 0 )
+    {
+        result = address;
+    }else
+    {
+        digitalWrite(cart->nLED, LOW);
+        result = blankCheck(address, size, true);
+        digitalWrite(cart->nLED, HIGH);
+    }
+
+    //Send something other than a "." to indicate we are done
+    Serial.print("!");
+    if( result == BLANK )
+    {
+        Serial.println(F("blank"));
+    }else
+    {
+        Serial.println(result, DEC);
+    }
+}
+
+/*******************************************************************//**
+ *  \brief Erases the sectors of the cart covering a range
+ *  Requires set mode to be issued prior. Falls back to erasing the whole
+ *  chip when its sector map is unknown.
+ *  
+ *  Usage:
+ *  erasesec 0x0000 0x80000
+ *    - prints "." while busy then "!" and "done" or "error" when a
+ *      sector failed or timed out
+ *  
+ *  \return Void
+ **********************************************************************/
+void eraseSectors()
+{
+    char *arg;
+    uint32_t address = 0, size = 0;
+    bool success;
+
+    arg = SCmd.next();
+    if( arg != NULL )
+    {
+        address = strtoul(arg, (char**)0, 0);
+        arg = SCmd.next();
+        if( arg != NULL )
+        {
+            size = strtoul(arg, (char**)0, 0);
+        }
+    }
+
+    digitalWrite(cart->nLED, LOW);
+    success = eraseRange(address, size, true);
+    digitalWrite(cart->nLED, HIGH);
+
+    //Send something other than a "." to indicate we are done
+    Serial.print("!");
+    if( success )
+    {
+        Serial.println(F("done"));
+    }else
+    {
+        Serial.println(F("error"));
+    }
+}
+
 /*******************************************************************//**
  *  \brief Get the Flash ID
  *  Reads the ID of the corresponding Flash IC.
@@ -350,6 +580,8 @@ void calcChecksum()
  *  Usage:
  *  rdbblk 0x0000 128
  *    - returns 128 bytes starting at address 0x0000
+ *  rdbblk 0x8000 128 s
+ *    - returns 128 bytes of SRAM starting at address 0x8000
  *  
  *  \return Void
  **********************************************************************/
@@ -357,904 +589,2340 @@ void readByteBlock()
 {
     char *arg;
     uint32_t address = 0;
-    uint16_t blockSize = 0, i;
-    uint8_t data;
-
-    //get the address in the next argument
-    arg = SCmd.next();
-    address = strtoul(arg, (char**)0, 0);
-    
-    //get the size in the next argument
-    arg = SCmd.next(); 
-    blockSize = strtoul(arg, (char**)0, 0);
-    
-    digitalWrite(cart->nLED, LOW);
-    
-    // reverse the bytes for PCE
-    if( cart->info.mirrored_bus ){
-        for( i = 0; i < blockSize; i++ ){
-            data = cart->readByte(address++);
-            Serial.write((char)(cart->mirror_byte(data)));
-        }
-    }else{
-        for( i = 0; i < blockSize; i++ ){
-            data = cart->readByte(address++);
-            Serial.write((char)(data));
-        }
-    }
-    
-    digitalWrite(cart->nLED, HIGH);
-}
-
-/*******************************************************************//**
- *  \brief Read a block of words from the cartridge
- *  
- *  Usage:
- *  rdwblk 0x0000 128
- *    - returns 128 unformated bytes
- *  
- *  \return Void
- **********************************************************************/
-void readWordBlock()
-{
-    char *arg;
+    uint16_t blockSize = 0;
     bool sramRead = false;
-    bool latchBankRead = false;
-    uint32_t address = 0, addrOffset = 0;
-    uint16_t blockSize = 0, i, restBlockSize = 0;
-    uint16_t data;
 
     //get the address in the next argument
     arg = SCmd.next();
     address = strtoul(arg, (char**)0, 0);
-    
+
     //get the size in the next argument
-    arg = SCmd.next(); 
+    arg = SCmd.next();
     blockSize = strtoul(arg, (char**)0, 0);
-    
+
     //check for next argument, if present, for type of read
     arg = SCmd.next();
-    if( arg != NULL )
+    if( ( arg != NULL ) && ( *arg == 's' ) )
     {
-        switch(*arg)
-        {
-            case 's':
-                sramRead = true;
-                break;
-            default:
-                break;
-        }
+        sramRead = true;
     }
 
-    if( address + blockSize >= 0x400000)
-    {
-        latchBankRead = true;
-        restBlockSize = blockSize;
-        if(address < 0x400000)
-        {
-            blockSize = 0x400000 - address;
-            restBlockSize -= blockSize;
-        }
-        else
-        {
-            addrOffset = address - 0x400000;
-            blockSize = 0;
-        }
-    }
-    
     digitalWrite(cart->nLED, LOW);
-    
+
     if( sramRead )
     {
         cart->enableSram(0);
-        //read words from block, output converts to little endian
-        for( i = 0; i < blockSize; i += 2 )
-        {
-            data = cart->readWord(address);
-            address += 2;
-            Serial.write((char)(data));
-            Serial.write((char)(data>>8));
-        }
+        sendByteBlock(address, blockSize);
         cart->disableSram(0);
-        
-    }else if( latchBankRead )
+    }else
     {
-        cart->writeByteTime(0xA130FD, 0x08); // map bank 8 to 0x300000 - 0x37FFFF
-        cart->writeByteTime(0xA130FF, 0x09); // map bank 9 to 0x380000 - 0x3FFFFF
+        sendByteBlock(address, blockSize);
+    }
 
-        address = 0x300000 + addrOffset; // TODO: Should start at 0x300000 BUG
+    digitalWrite(cart->nLED, HIGH);
+}
 
-        //read the rest of the words from bank switched block, output is little endian
-        for( i = 0; i < restBlockSize; i += 2 )
-        {
-            data = cart->readWord(address);
-            address += 2;
-            Serial.write((char)(data));
-            Serial.write((char)(data>>8));
-        }
+/*******************************************************************//**
+ *  \brief Burst read bytes from the cartridge and send them to the PC
+ *  The read is pipelined through the two halves of dataBuffer, each stage
+ *  is handed to the USB endpoint which transmits it in hardware while the
+ *  next stage is read from the cartridge into the other half.
+ *  \param address 24bit start address
+ *  \param size number of bytes to send
+ *  \return Void
+ **********************************************************************/
+void sendByteBlock(uint32_t address, uint32_t size)
+{
+    uint16_t i, count;
+    char *stage;
 
-        cart->writeByteTime(0xA130FD, 0x06); // return banks to original state
-        cart->writeByteTime(0xA130FF, 0x07); // return banks to original state
-    }else
+    while( size > 0 )
     {
-        //read words from block, output is little endian
-        for( i = 0; i < blockSize; i += 2 )
+        count = ( size > PIPE_STAGE_SIZE ) ? PIPE_STAGE_SIZE : size;
+        stage = swapPipeStage();
+        cart->readByteBurst(address, (uint8_t *)stage, count);
+
+        // reverse the bytes for PCE
+        if( cart->info.mirrored_bus )
         {
-            data = cart->readWord(address);
-            address += 2;
-            Serial.write((char)(data));
-            Serial.write((char)(data>>8));
+            for( i = 0; i < count; i++ )
+            {
+                stage[i] = cart->mirror_byte(stage[i]);
+            }
         }
+
+        // only waits if the endpoint banks are still busy with the previous stage
+        sendStage(stage, count);
+
+        address += count;
+        size -= count;
     }
 
-    digitalWrite(cart->nLED, HIGH);
+    // push out the last partial packet now rather than on the USB timeout
+    Serial.send_now();
 }
 
 /*******************************************************************//**
- *  \brief Read a block from the cartridge
- *  
- *  Usage:
- *  rdwblk 0x0000 128
- *    - returns 128 unformated bytes
- *  
+ *  \brief Burst read words from the cartridge and send them to the PC,
+ *         output is little endian
+ *  Pipelined through the two halves of dataBuffer like sendByteBlock.
+ *  \param address 24bit start address
+ *  \param size number of bytes to send
  *  \return Void
  **********************************************************************/
-void readBlock()
+void sendWordBlock(uint32_t address, uint32_t size)
 {
-    char *arg;
-    bool sramRead = false;
-    bool latchBankRead = false;
-    uint32_t address = 0, addrOffset = 0;
-    uint16_t blockSize = 0, i, restBlockSize = 0;
-    uint16_t readWord;
+    uint16_t count;
+    char *stage;
 
-    //get the address in the next argument
-    arg = SCmd.next();
-    address = strtoul(arg, (char**)0, 0);
-    
-    //get the size in the next argument
-    arg = SCmd.next(); 
-    blockSize = strtoul(arg, (char**)0, 0);
-    
-    //check for next argument, if present, for type of read
-    arg = SCmd.next();
-    if( arg != NULL )
+    while( size > 0 )
     {
-        switch(*arg)
-        {
-            case 's':
-                sramRead = true;
-                break;
-            default:
-                break;
-        }
+        count = ( size > PIPE_STAGE_SIZE ) ? PIPE_STAGE_SIZE : size;
+        stage = swapPipeStage();
+        cart->readWordBurst(address, (uint16_t *)stage, count >> 1);
+
+        // only waits if the endpoint banks are still busy with the previous stage
+        sendStage(stage, count);
+
+        address += count;
+        size -= count;
     }
 
-    digitalWrite(cart->nLED, LOW);
+    // push out the last partial packet now rather than on the USB timeout
+    Serial.send_now();
+}
 
-    // 8 bit reads
-    if( cart->info.bus_size == 8 )
+/*******************************************************************//**
+ *  \brief Switch to the other half of dataBuffer for the next read
+ *         pipeline stage
+ *  \return the stage buffer to fill
+ **********************************************************************/
+char *swapPipeStage()
+{
+    pipeStage = ( pipeStage == dataBuffer.byte ) ? &dataBuffer.byte[DATA_BUFFER_SIZE/2] : dataBuffer.byte;
+    return pipeStage;
+}
+
+/*******************************************************************//**
+ *  \brief Hand a read pipeline stage to USB, compressed when enabled
+ *  \param stage the stage buffer
+ *  \param count number of bytes in the stage
+ *  \return Void
+ **********************************************************************/
+void sendStage(const char *stage, uint16_t count)
+{
+    if( crcEnabled )
     {
-        
-    // 16 bit reads
+        crcValue = crc32Update(crcValue, (const uint8_t *)stage, count);
+    }
+
+    if( rleEnabled )
+    {
+        rleStage(stage, count);
     }else
     {
-        if( address + blockSize >= 0x400000)
-        {
-            latchBankRead = true;
-            restBlockSize = blockSize;
-            if(address < 0x400000)
-            {
-                blockSize = 0x400000 - address;
-                restBlockSize -= blockSize;
-            }else
-            {
-                addrOffset = address - 0x400000;
-                blockSize = 0;
-            }
-        }
-        
-        if( sramRead )
-        {
-            cart->enableSram(0);
-            //read words from block, output converts to little endian
-            for( i = 0; i < blockSize; i += 2 )
-            {
-                readWord = cart->readWord(address);
-                address += 2;
-                Serial.write((char)(readWord));
-                Serial.write((char)(readWord>>8));
-            }
-            cart->disableSram(0);
-            
-        }else if( latchBankRead )
-        {
-            cart->writeByteTime(0xA130FD, 0x08); // map bank 8 to 0x300000 - 0x37FFFF
-            cart->writeByteTime(0xA130FF, 0x09); // map bank 9 to 0x380000 - 0x3FFFFF
+        Serial.write(stage, count);
+    }
+}
 
-            address = 0x300000 + addrOffset; // TODO: Should start at 0x300000 BUG
+/*******************************************************************//**
+ *  \brief Start compressing the read stream
+ *  \return Void
+ **********************************************************************/
+void rleBegin()
+{
+    rleEnabled = true;
+    rleHavePrev = false;
+    rleRunCount = 0;
+}
 
-            //read the rest of the words from bank switched block, output is little endian
-            for( i = 0; i < restBlockSize; i += 2 )
-            {
-                readWord = cart->readWord(address);
-                address += 2;
-                Serial.write((char)(readWord));
-                Serial.write((char)(readWord>>8));
-            }
+/*******************************************************************//**
+ *  \brief Compress one read pipeline stage
+ *  A stage of a single repeated value extends a BIN_RLE_FILL run, a
+ *  stage identical to the previous one (still in the other half of
+ *  dataBuffer) extends a BIN_RLE_REPEAT run, anything else is sent as a
+ *  BIN_RLE_LITERAL.
+ *  \param stage the stage buffer
+ *  \param count number of bytes in the stage
+ *  \return Void
+ **********************************************************************/
+void rleStage(const char *stage, uint16_t count)
+{
+    const char *prev = ( stage == dataBuffer.byte ) ? &dataBuffer.byte[DATA_BUFFER_SIZE/2] : dataBuffer.byte;
+    uint8_t token[2];
+    uint8_t value = (uint8_t)stage[0];
+    uint16_t i;
+
+    for( i = 1; ( i < count ) && ( (uint8_t)stage[i] == value ); i++ );
 
-            cart->writeByteTime(0xA130FD, 0x06); // return banks to original state
-            cart->writeByteTime(0xA130FF, 0x07); // return banks to original state
+    if( i == count )
+    {
+        if( rleRunCount && ( rleRunType == BIN_RLE_FILL ) && ( rleRunValue == value ) && ( rleRunCount < 0xFF ) )
+        {
+            rleRunCount++;
         }else
         {
-            //read words from block, output is little endian
-            for( i = 0; i < blockSize; i += 2 )
-            {
-                readWord = cart->readWord(address);
-                address += 2;
-                Serial.write((char)(readWord));
-                Serial.write((char)(readWord>>8));
-            }
+            rleFlush();
+            rleRunType = BIN_RLE_FILL;
+            rleRunValue = value;
+            rleRunCount = 1;
+        }
+    }else if( rleHavePrev && ( rlePrevCount == count ) && ( memcmp(stage, prev, count) == 0 ) )
+    {
+        if( rleRunCount && ( rleRunType == BIN_RLE_REPEAT ) && ( rleRunCount < 0xFF ) )
+        {
+            rleRunCount++;
+        }else
+        {
+            rleFlush();
+            rleRunType = BIN_RLE_REPEAT;
+            rleRunCount = 1;
         }
+    }else
+    {
+        rleFlush();
+        token[0] = BIN_RLE_LITERAL;
+        token[1] = 1;
+        Serial.write((const char *)token, 2);
+        Serial.write(stage, count);
     }
 
-    digitalWrite(cart->nLED, HIGH);
+    rleHavePrev = true;
+    rlePrevCount = count;
 }
 
 /*******************************************************************//**
- * \brief
- * Usage:
- 
- * \return Void
+ *  \brief Send the run being accumulated, if any
+ *  \return Void
  **********************************************************************/
-void writeSRAMByteBlock()
+void rleFlush()
 {
-    char *arg;
-    uint32_t address=0;
-    uint16_t blockSize, count=0;
-            
-    //get the address in the next argument
-    arg = SCmd.next();
-    address = strtoul(arg, (char**)0, 0);
-    
-    //get the size in the next argument
-    arg = SCmd.next();
-    blockSize = strtoul(arg, (char**)0, 0);
-    
-    digitalWrite(cart->nLED, LOW);
-    
-    //receive size bytes
-    Serial.read(); //there's an extra byte here for some reason - discard
-    
-    while( count < blockSize )
+    uint8_t token[3];
+
+    if( rleRunCount == 0 )
+    {
+        return;
+    }
+
+    token[0] = rleRunType;
+    token[1] = rleRunCount;
+    token[2] = rleRunValue;
+    Serial.write((const char *)token, ( rleRunType == BIN_RLE_FILL ) ? 3 : 2);
+    rleRunCount = 0;
+}
+
+/*******************************************************************//**
+ *  \brief Stop compressing the read stream, sends the last run
+ *  \return Void
+ **********************************************************************/
+void rleEnd()
+{
+    rleFlush();
+    Serial.send_now();
+    rleEnabled = false;
+}
+
+/*******************************************************************//**
+ *  \brief Start a CRC-32 of the read stream
+ *  \return Void
+ **********************************************************************/
+void crcBegin()
+{
+    crcEnabled = true;
+    crcValue = CRC32_INIT;
+}
+
+/*******************************************************************//**
+ *  \brief Stop the CRC-32 of the read stream and send it as the trailer
+ *  \return Void
+ **********************************************************************/
+void crcEnd()
+{
+    uint32_t crc = crc32Final(crcValue);
+
+    Serial.write((const char *)&crc, sizeof(crc));
+    Serial.send_now();
+    crcEnabled = false;
+}
+
+/*******************************************************************//**
+ *  \brief Find the first byte that is not erased in a range using burst
+ *         reads
+ *  \param address 24bit start address
+ *  \param size number of bytes to check
+ *  \param progress print a "." every 64KB checked to keep the PC from
+ *         timing out
+ *  \return the address of the first byte that is not 0xFF, BLANK if none
+ **********************************************************************/
+uint32_t blankCheck(uint32_t address, uint32_t size, bool progress)
+{
+    uint16_t i, count;
+    uint32_t checked = 0;
+    uint8_t all;
+
+    while( size > 0 )
     {
-        if( Serial.available() )
+        count = ( size > DATA_BUFFER_SIZE ) ? DATA_BUFFER_SIZE : size;
+        if( cart->info.bus_size == 16 )
+        {
+            cart->readWordBurst(address, dataBuffer.word, count >> 1);
+        }else
+        {
+            cart->readByteBurst(address, (uint8_t *)dataBuffer.byte, count);
+        }
+
+        // AND everything together, only look for the culprit if there is one
+        all = 0xFF;
+        for( i = 0; i < count; i++ )
+        {
+            all &= dataBuffer.byte[i];
+        }
+        if( all != 0xFF )
+        {
+            for( i = 0; (uint8_t)dataBuffer.byte[i] == 0xFF; i++ );
+            return address + i;
+        }
+
+        address += count;
+        size -= count;
+
+        // count the bytes checked, the start isn't always 64KB aligned
+        checked += count;
+        if( progress && ( checked >= 0x10000 ) )
         {
-            dataBuffer.byte[count++] = Serial.read();
+            checked -= 0x10000;
+            Serial.print(".");
         }
     }
-    
-    SCmd.clearBuffer();
-    
-    //enable the sram
-    cart->enableSram(0);
-    
-    //sram writes different for 8bit and 16bit busses
-    if( cart->info.bus_size == 16 )
+
+    return BLANK;
+}
+
+/*******************************************************************//**
+ *  \brief Erase every sector of the flash covering a range, the whole
+ *         chip if the sector map of the flash is unknown
+ *  The erase is waited for with data polling, the cartridge's pollIdle
+ *  keeps running while the flash is busy.
+ *  \param address 24bit start address
+ *  \param size number of bytes to erase
+ *  \param progress print a "." for every sector and every 250ms of a chip
+ *         erase to keep the PC from timing out
+ *  \return true when every erase completed, false on a failed or timed
+ *          out erase or a range running past the end of the flash
+ **********************************************************************/
+bool eraseRange(uint32_t address, uint32_t size, bool progress)
+{
+    uint32_t end = address + size;
+    uint32_t sectorSize, timeout;
+    umdv1::status_e status = umdv1::STATUS_OK;
+
+    cart->getFlashID();
+
+    // the range must be mapped completely, else erase everything
+    if( ( size == 0 ) || ( cart->getSectorSize(address) == 0 ) )
     {
-        //Genesis SRAM only on odd bytes
-        if( cart->info.console == umdv1::GENESIS )
+        if( progress )
         {
-            for( count=1; count < blockSize ; count += 2 )
-            {
-                cart->writeByte( address, dataBuffer.byte[count]);
-                address += 2;
-            }
+            cart->pollIdle = eraseProgress;
         }
-    }else
+
+        cart->eraseChip(false);
+        timeout = ( cart->flashID.chipEraseTimeout ? cart->flashID.chipEraseTimeout : CHIP_ERASE_TIMEOUT ) * 1000UL;
+        if( cart->info.bus_size == 16 )
+        {
+            status = cart->pollWord(0, 0xFFFF, timeout);
+        }else
+        {
+            status = cart->pollByte(0, 0xFF, timeout);
+        }
+
+        if( progress )
+        {
+            cart->pollIdle = NULL;
+        }
+        return ( status == umdv1::STATUS_OK );
+    }
+
+    // a range running past the end of the sector map can't be erased
+    if( cart->getSectorSize(end - 1) == 0 )
+    {
+        return false;
+    }
+
+    while( ( address < end ) && ( status == umdv1::STATUS_OK ) )
     {
-        for( count=0; count < blockSize ; count++ )
+        sectorSize = cart->getSectorSize(address);
+        if( sectorSize == 0 )
         {
-            cart->writeByte( address++, dataBuffer.byte[count]);
+            return false;
+        }
+        status = cart->eraseSector(address, true);
+        address = ( address & ~( sectorSize - 1 ) ) + sectorSize;
+
+        if( progress )
+        {
+            Serial.print(".");
         }
     }
-    
-    cart->disableSram(0);
-    
-    Serial.println(F("done"));
-    digitalWrite(cart->nLED, HIGH);
+
+    return ( status == umdv1::STATUS_OK );
 }
 
 /*******************************************************************//**
- *  \brief Program a byte block in the cartridge
+ *  \brief Chip erase pollIdle, print a "." every 250ms so the PC
+ *         doesn't time out
+ *  \return Void
+ **********************************************************************/
+void eraseProgress()
+{
+    static uint32_t intervalMillis;
+
+    if( (millis() - intervalMillis) > 250 )
+    {
+        Serial.print(".");
+        intervalMillis = millis();
+    }
+}
+
+/*******************************************************************//**
+ *  \brief Burst read from the cartridge without sending anything to the
+ *         PC, only the CRC-32 is kept
+ *  The data is hashed exactly as sendByteBlock/sendWordBlock would send
+ *  it so the result matches the CRC-32 of a dumped file.
+ *  \param address 24bit start address
+ *  \param size number of bytes to hash
+ *  \return the CRC-32
+ **********************************************************************/
+uint32_t hashBlock(uint32_t address, uint32_t size)
+{
+    uint32_t crc = CRC32_INIT;
+    uint16_t i, count;
+
+    while( size > 0 )
+    {
+        count = ( size > DATA_BUFFER_SIZE ) ? DATA_BUFFER_SIZE : size;
+        if( cart->info.bus_size == 16 )
+        {
+            cart->readWordBurst(address, dataBuffer.word, count >> 1);
+        }else
+        {
+            cart->readByteBurst(address, (uint8_t *)dataBuffer.byte, count);
+
+            // reverse the bytes for PCE
+            if( cart->info.mirrored_bus )
+            {
+                for( i = 0; i < count; i++ )
+                {
+                    dataBuffer.byte[i] = cart->mirror_byte(dataBuffer.byte[i]);
+                }
+            }
+        }
+
+        crc = crc32Update(crc, (const uint8_t *)dataBuffer.byte, count);
+        address += count;
+        size -= count;
+    }
+
+    return crc32Final(crc);
+}
+
+/*******************************************************************//**
+ *  \brief Read a block of words from the cartridge
  *  
  *  Usage:
- *  progword 0x0000 0x12
- *    - programs 0x12 into address 0x0000
- *  progword 412 12
- *    - programs decimal 12 into address decimal 412
+ *  rdwblk 0x0000 128
+ *    - returns 128 unformated bytes
  *  
  *  \return Void
  **********************************************************************/
-void programByteBlock()
+void readWordBlock()
 {
     char *arg;
-    uint32_t address=0;
-    uint16_t blockSize, count=0;
-            
+    bool sramRead = false;
+    uint32_t address = 0;
+    uint16_t blockSize = 0;
+
     //get the address in the next argument
     arg = SCmd.next();
     address = strtoul(arg, (char**)0, 0);
     
     //get the size in the next argument
-    arg = SCmd.next();
+    arg = SCmd.next(); 
     blockSize = strtoul(arg, (char**)0, 0);
     
-    digitalWrite(cart->nLED, LOW);
-    
-    //receive size bytes
-    Serial.read(); //there's an extra byte here for some reason - discard
-    
-    // reverse the bytes as they come in for PCE
-    if( cart->info.mirrored_bus ){
-        while( count < blockSize ){
-            if( Serial.available() ){
-                dataBuffer.byte[count++] = cart->mirror_byte(Serial.read());
-            }
-        }
-    }else{
-        while( count < blockSize ){
-            if( Serial.available() ){
-                dataBuffer.byte[count++] = Serial.read();
-            }
+    //check for next argument, if present, for type of read
+    arg = SCmd.next();
+    if( arg != NULL )
+    {
+        switch(*arg)
+        {
+            case 's':
+                sramRead = true;
+                break;
+            default:
+                break;
         }
     }
-    
-    SCmd.clearBuffer();
-    
-    count = 0;
-    while( count < blockSize ){
 
-        cart->writeByte( (uint32_t)0x00000555, 0xAA);
-        cart->writeByte( (uint32_t)0x000002AA, 0x55);
-        cart->writeByte( (uint32_t)0x00000555, 0xA0);
+    digitalWrite(cart->nLED, LOW);
+    
+    if( sramRead )
+    {
+        cart->enableSram(0);
+        //read words from block, output converts to little endian
+        sendWordBlock(address, blockSize);
+        cart->disableSram(0);
         
-        //write the data
-        cart->writeByte( (uint32_t)address, dataBuffer.byte[count++] );
-        address++;
-
-        //use data polling to validate end of program cycle
-        while( cart->toggleBit16(4) != 4 );
+    }else
+    {
+        //read words from block, output is little endian
+        sendWordBlock(address, blockSize);
     }
-    
-    Serial.println(F("done"));
+
     digitalWrite(cart->nLED, HIGH);
 }
 
 /*******************************************************************//**
- *  \brief Program a word block in the cartridge
- *  Program a word in the cartridge. Prior to progamming,
- *  the sector or entire chip must be erased. The function
- *  returns immediately without checking if the operation
- *  has completed (i.e. toggle bit)
+ *  \brief Read a block from the cartridge
  *  
  *  Usage:
- *  progword 0x0000 0x12
- *    - programs 0x12 into address 0x0000
- *  progword 412 12
- *    - programs decimal 12 into address decimal 412
+ *  rdwblk 0x0000 128
+ *    - returns 128 unformated bytes
  *  
  *  \return Void
  **********************************************************************/
-void programWordBlock()
+void readBlock()
 {
     char *arg;
-    uint32_t address=0, sectorAddr;
-    uint16_t blockSize, count=0;
-    uint8_t i;
-            
+    bool sramRead = false;
+    uint32_t address = 0;
+    uint16_t blockSize = 0;
+
     //get the address in the next argument
     arg = SCmd.next();
     address = strtoul(arg, (char**)0, 0);
     
     //get the size in the next argument
-    arg = SCmd.next();
+    arg = SCmd.next(); 
     blockSize = strtoul(arg, (char**)0, 0);
     
-    digitalWrite(cart->nLED, LOW);
-    
-    //receive size bytes
-    Serial.read(); //there's an extra byte here for some reason - discard
-    
-    while( count < blockSize ){
-        if( Serial.available() ){
-            dataBuffer.byte[count++] = Serial.read();
+    //check for next argument, if present, for type of read
+    arg = SCmd.next();
+    if( arg != NULL )
+    {
+        switch(*arg)
+        {
+            case 's':
+                sramRead = true;
+                break;
+            default:
+                break;
         }
     }
-    
-    SCmd.clearBuffer();
-    
-    //program size/2 words
-    //if( cart->flashID.buffermode == 0 ){
-    if( 1 ){
-        count = 0;
-        while( count < ( blockSize >> 1) ){
-
-            cart->writeWord( (uint32_t)(0x000555 << 1), 0xAA00);
-            cart->writeWord( (uint32_t)(0x0002AA << 1), 0x5500);
-            cart->writeWord( (uint32_t)(0x000555 << 1), 0xA000);
-            
-            //write the data
-            cart->writeWord( (uint32_t)address, dataBuffer.word[count++] );
-            address += 2;
-
-            //use data polling to validate end of program cycle
-            while( cart->toggleBit16(4) != 4 );
-        }
-    }else{
-        count = 0;
-        while( count < ( blockSize >> 1) ){
-            // address must fall within a 32b/16w boundary
-            address &= 0xFFFFFFE0;
-            sectorAddr = address;
-
-            // enter write to buffer mode
-            cart->writeWord( (uint32_t)(0x000555 << 1), 0xAA00);
-            cart->writeWord( (uint32_t)(0x0002AA << 1), 0x5500);
-            cart->writeWord( sectorAddr, 0x2500);
-            // word count minus 1
-            cart->writeWord( sectorAddr, 15);
-
-            // write contents to program flash buffer
-            for(i=0; i<16; i++){
-                cart->writeWord( address, dataBuffer.word[count++] );
-                address += 2;
-            }
 
-            // program buffer to flash command
-            cart->writeWord( sectorAddr, 0x2900);
+    digitalWrite(cart->nLED, LOW);
 
-            //use data polling to validate end of program cycle
-            while( cart->toggleBit16(4) != 4 );
+    // 8 bit reads
+    if( cart->info.bus_size == 8 )
+    {
+        
+    // 16 bit reads
+    }else
+    {
+        if( sramRead )
+        {
+            cart->enableSram(0);
+            //read words from block, output converts to little endian
+            sendWordBlock(address, blockSize);
+            cart->disableSram(0);
+            
+        }else
+        {
+            //read words from block, output is little endian
+            sendWordBlock(address, blockSize);
         }
     }
-    
-    Serial.println(F("done"));
+
     digitalWrite(cart->nLED, HIGH);
 }
 
-
 /*******************************************************************//**
- *  \brief Read the onboard serial flash ID
- *  \return Void
+ * \brief
+ * Usage:
+ 
+ * \return Void
  **********************************************************************/
-void sfGetID()
+void writeSRAMByteBlock()
 {
-    //W25Q128FVSIG
-    Serial.write(sfID[0]);
-    Serial.write(sfID[1]);
-    Serial.write(sfID[2]);
-    Serial.write(sfID[3]);
-    Serial.write(sfID[4]);
+    char *arg;
+    uint32_t address=0;
+    uint16_t blockSize;
+            
+    //get the address in the next argument
+    arg = SCmd.next();
+    address = strtoul(arg, (char**)0, 0);
+    
+    //get the size in the next argument
+    arg = SCmd.next();
+    blockSize = strtoul(arg, (char**)0, 0);
+    
+    digitalWrite(cart->nLED, LOW);
+    
+    //receive size bytes
+    Serial.read(); //there's an extra byte here for some reason - discard
+    receiveBlock(blockSize, false);
+    
+    SCmd.clearBuffer();
+    
+    writeSramBlock(address, blockSize);
+    
+    Serial.println(F("done"));
+    digitalWrite(cart->nLED, HIGH);
 }
 
-
 /*******************************************************************//**
- *  \brief Get the size of the onboard serial flash
+ *  \brief Fill dataBuffer with bytes received from the PC
+ *  \param size number of bytes to receive
+ *  \param mirror reverse the bits of every byte as it comes in
  *  \return Void
  **********************************************************************/
-void sfGetSize()
+void receiveBlock(uint16_t size, bool mirror)
 {
-    //W25Q128FVSIG
-    Serial.println(sfSize,DEC);
+    uint16_t count = 0;
+
+    // reverse the bytes as they come in for PCE
+    if( mirror ){
+        while( count < size ){
+            if( Serial.available() ){
+                dataBuffer.byte[count++] = cart->mirror_byte(Serial.read());
+            }
+        }
+    }else{
+        while( count < size ){
+            if( Serial.available() ){
+                dataBuffer.byte[count++] = Serial.read();
+            }
+        }
+    }
 }
 
 /*******************************************************************//**
- *  \brief Erase the serial flash
+ *  \brief Write the contents of dataBuffer to the cartridge SRAM
+ *  \param address 24bit start address
+ *  \param size number of bytes in dataBuffer
  *  \return Void
  **********************************************************************/
-void sfEraseAll()
+void writeSramBlock(uint32_t address, uint16_t size)
 {
-    char *arg;
+    uint16_t count;
 
-    arg = SCmd.next();
-    if( arg != NULL )
+    //enable the sram
+    cart->enableSram(0);
+    
+    //sram writes different for 8bit and 16bit busses
+    if( cart->info.bus_size == 16 )
     {
-        switch(*arg)
+        //Genesis SRAM only on odd bytes
+        if( cart->info.console == umdv1::GENESIS )
         {
-            //wait for operation to complete, measure time
-            case 'w':
-                SerialFlash.eraseAll();
-                while (SerialFlash.ready() == false) {
-                    // wait, 30 seconds to 2 minutes for most chips
-                    digitalWrite(cart->nLED, LOW);
-                    delay(250);
-                    digitalWrite(cart->nLED, HIGH);
-                    delay(250);
-                    Serial.print(".");
-                }
-                Serial.print("!");
-                break;
-            default:
-                break;
+            for( count=1; count < size ; count += 2 )
+            {
+                cart->writeByte( address, dataBuffer.byte[count]);
+                address += 2;
+            }
         }
     }else
     {
-        SerialFlash.eraseAll();
+        cart->writeByteBurst(address, (uint8_t *)dataBuffer.byte, size);
     }
+    
+    cart->disableSram(0);
 }
 
 /*******************************************************************//**
- *  \brief Burn a file from the serial flash to the cartridge
+ *  \brief Program a byte block in the cartridge
  *  
  *  Usage:
- *  sflburn rom.bin
+ *  progword 0x0000 0x12
+ *    - programs 0x12 into address 0x0000
+ *  progword 412 12
+ *    - programs decimal 12 into address decimal 412
  *  
  *  \return Void
  **********************************************************************/
-void sfBurnCart()
+void programByteBlock()
 {
     char *arg;
-    uint16_t blockSize, i;
-    uint32_t timer, fileSize, address=0, pos=0;
-    char fileName[13];      //Max filename length (8.3 plus a null char terminator)
-    
-    //get the file name
+    uint32_t address=0;
+    uint16_t blockSize;
+            
+    //get the address in the next argument
     arg = SCmd.next();
-    i = 0;
-    while( (*arg != 0) && ( i < 12) )
-    {
-        fileName[i++] = *(arg++);
-    }
-    fileName[i] = 0; //null char terminator
+    address = strtoul(arg, (char**)0, 0);
     
-        //get the read block size
+    //get the size in the next argument
     arg = SCmd.next();
     blockSize = strtoul(arg, (char**)0, 0);
     
-    //start a timer
-    timer = millis();
-
-    flashFile = SerialFlash.open(fileName);
-    if (flashFile)
-    {
-        Serial.println(F("found"));
-        fileSize = flashFile.size();
-        Serial.println(fileSize,DEC);
-        
-        while( pos < fileSize )
-        {
-            if(millis() - timer > 250){
-                digitalWrite(cart->nLED, !digitalRead(cart->nLED));
-                timer = millis();
-            }
-
-            flashFile.read(dataBuffer.byte, blockSize);
-            
-            if( cart->info.bus_size == 16 )
-            {
-                for( i=0 ; i < ( blockSize >> 1) ; i++ )
-                {
-                    cart->programWord(address, dataBuffer.word[i], true);
-                    address += 2;
-                }
-            }else
-            {
-                for( i=0 ; i < blockSize ; i++ )
-                {
-                    cart->programByte(address, dataBuffer.byte[i], true);
-                    address++;
-                }
-            }
-            pos += blockSize;
-            Serial.println(pos, DEC);
-        }
+    digitalWrite(cart->nLED, LOW);
+    
+    //receive size bytes
+    Serial.read(); //there's an extra byte here for some reason - discard
+    receiveBlock(blockSize, cart->info.mirrored_bus);
+    
+    SCmd.clearBuffer();
+    
+    if( burnByteBlock(address, blockSize, (uint8_t *)dataBuffer.byte) ){
         Serial.println(F("done"));
-    }else
-    {
+    }else{
         Serial.println(F("error"));
     }
-    
-    flashFile.close();
     digitalWrite(cart->nLED, HIGH);
 }
 
 /*******************************************************************//**
- *  \brief Burn a file from the serial flash to the cartridge
- *  
- *  Usage:
- *  sflburn rom.bin
- *  
- *  \return Void
+ *  \brief Program the contents of a buffer into the cartridge with
+ *         programByteBuffer(), in unlock bypass mode when the flash has
+ *         it. 0xFF bytes are left erased. Bytes that read back wrong are
+ *         added to programFails
+ *  \param address 24bit start address
+ *  \param size number of bytes in buf
+ *  \param buf bytes to program, usually dataBuffer
+ *  \return false if a byte failed or timed out, the rest of the block
+ *          is not programmed
  **********************************************************************/
-void sfEraseCartBurnAuto(uint16_t blockSize)
+bool burnByteBlock(uint32_t address, uint16_t size, uint8_t *buf)
 {
-    uint16_t i;
-    uint32_t timer, fileSize, address=0, pos=0;
-    
-    digitalWrite(cart->nLED, LOW);
-    cart->eraseChip(true);
-    
-    // flash to signal erase is complete
-    flash_led(4, 100);
-    
-    //start a timer
-    timer = millis();
+    uint16_t count;
+    umdv1::status_e status;
 
-    flashFile = SerialFlash.open("auto");
-    if (flashFile){
-        fileSize = flashFile.size();
-        
-        while( pos < fileSize ){
+    cart->enterBypass();
+    status = cart->programByteBuffer(address, buf, size);
+    cart->exitBypass();
 
-            if(millis() - timer > 250){
-                digitalWrite(cart->nLED, !digitalRead(cart->nLED));
-                timer = millis();
-            }
+    if( ( status == umdv1::STATUS_FAIL ) || ( status == umdv1::STATUS_TIMEOUT ) ){
+        return false;
+    }
 
-            flashFile.read(dataBuffer.byte, blockSize);
-            if( cart->info.bus_size == 16 ){
-                for( i=0 ; i < ( blockSize >> 1) ; i++ )
-                {
-                    cart->programWord(address, dataBuffer.word[i], true);
-                    address += 2;
-                }
-            }else{
-                for( i=0 ; i < blockSize ; i++ ){
-                    cart->programByte(address, dataBuffer.byte[i], true);
-                    address++;
-                }
+    // the block only reports that a byte read back wrong, find which
+    if( status == umdv1::STATUS_VERIFY ){
+        for( count = 0; count < size; count++ ){
+            if( ( buf[count] != 0xFF ) && ( cart->readByte(address + count) != buf[count] ) ){
+                programFailed(address + count);
             }
-            pos += blockSize;
         }
-        flash_led(4, 100);
-    }else{
-        flash_led(4, 500);
     }
-    
-    flashFile.close();
-}
 
+    return true;
+}
 
 /*******************************************************************//**
- *  \brief Read a file from the serial flash
+ *  \brief Program a word block in the cartridge
+ *  Program a word in the cartridge. Prior to progamming,
+ *  the sector or entire chip must be erased. The function
+ *  returns immediately without checking if the operation
+ *  has completed (i.e. toggle bit)
  *  
  *  Usage:
- *  sflread file.bin
+ *  progword 0x0000 0x12
+ *    - programs 0x12 into address 0x0000
+ *  progword 412 12
+ *    - programs decimal 12 into address decimal 412
  *  
  *  \return Void
  **********************************************************************/
-void sfReadFile()
+void programWordBlock()
 {
     char *arg;
-    uint16_t blockSize, i;
-    uint32_t fileSize, pos=0;
-    char fileName[13];      //Max filename length (8.3 plus a null char terminator)
-    
-    //get the file name
+    uint32_t address=0;
+    uint16_t blockSize;
+            
+    //get the address in the next argument
     arg = SCmd.next();
-    i = 0;
-    while( (*arg != 0) && ( i < 12) )
-    {
-        fileName[i++] = *(arg++);
-    }
-    fileName[i] = 0; //null char terminator
+    address = strtoul(arg, (char**)0, 0);
     
-    //get the read block size
+    //get the size in the next argument
     arg = SCmd.next();
     blockSize = strtoul(arg, (char**)0, 0);
     
     digitalWrite(cart->nLED, LOW);
     
-    flashFile = SerialFlash.open(fileName);
-    if (flashFile)
-    {
-        Serial.println(F("found"));
-        fileSize = flashFile.size();
-        Serial.println(fileSize,DEC);
-        
-        while( pos < fileSize )
-        {
-            flashFile.read(dataBuffer.byte, blockSize);
-            //wait for PC side to be ready to receive
-            //Serial.read();
-            
-            delay(1);
-            for( i = 0; i < blockSize; i++ )
-            {
-                Serial.write((char)dataBuffer.byte[i]);
-            }
-            
-            pos += blockSize;
-        }
-
-    }else
-    {
+    //receive size bytes
+    Serial.read(); //there's an extra byte here for some reason - discard
+    receiveBlock(blockSize, false);
+    
+    SCmd.clearBuffer();
+    
+    if( burnWordBlock(address, blockSize, dataBuffer.word) ){
+        Serial.println(F("done"));
+    }else{
         Serial.println(F("error"));
     }
-    flashFile.close();
-    
     digitalWrite(cart->nLED, HIGH);
 }
 
 /*******************************************************************//**
- *  \brief Write a file to the serial flash
- *  
- *  Usage:
- *  sflwrite rom.bin 4096 2048 xx[0] xx[1] ... xx[2047] /wait/ ... xx[4095] 
- *  Filename must be 12 chars or less (8.3)
- * 
- *  \return Void
+ *  \brief Program the contents of a buffer into the cartridge, with
+ *         the write buffer of the flash when getFlashID() found one
+ *         else one word at a time, in unlock bypass mode when the flash
+ *         has it. 0xFFFF words are left erased. Words that read back
+ *         wrong are added to programFails
+ *  \param address 24bit start address
+ *  \param size number of bytes in buf
+ *  \param buf words to program, usually dataBuffer
+ *  \return false if a word failed or timed out, the rest of the block
+ *          is not programmed
  **********************************************************************/
-void sfWriteFile()
+bool burnWordBlock(uint32_t address, uint16_t size, uint16_t *buf)
 {
-    char *arg;
-    uint16_t i, count, blockSize;
-    uint32_t fileSize, pos=0;
-    char fileName[13];      //Max filename length (8.3 plus a null char terminator)
+    uint16_t count, words, first, last, i;
+    umdv1::status_e status;
+    bool success = true;
 
-    //get the file name
-    arg = SCmd.next();
-    i = 0;
-    while( (*arg != 0) && ( i < 12) )
+    //program size/2 words
+    if( ( cart->flashID.buffermode == 0 ) || ( cart->flashID.bufferSize == 0 ) ){
+        count = 0;
+        cart->enterBypass();
+        while( success && ( count < ( size >> 1) ) ){
+
+            // erased flash already reads 0xFFFF
+            if( buf[count] != 0xFFFF ){
+                switch( cart->programWord( address, buf[count], true ) ){
+                    case umdv1::STATUS_OK:
+                        break;
+                    case umdv1::STATUS_VERIFY:
+                        programFailed(address);
+                        break;
+                    default:
+                        success = false;
+                        break;
+                }
+            }
+            address += 2;
+            count++;
+        }
+        cart->exitBypass();
+    }else{
+        count = 0;
+        while( success && ( count < ( size >> 1) ) ){
+            // fill up to the end of the current write buffer
+            words = ( cart->flashID.bufferSize - ( address & ( cart->flashID.bufferSize - 1 ) ) ) >> 1;
+            if( words > ( ( size >> 1 ) - count ) )
+            {
+                words = ( size >> 1 ) - count;
+            }
+
+            // leave out the erased words at both ends, all of them if blank
+            first = count;
+            last = count + words;
+            while( ( first < last ) && ( buf[first] == 0xFFFF ) ){
+                first++;
+            }
+            while( ( last > first ) && ( buf[last - 1] == 0xFFFF ) ){
+                last--;
+            }
+            if( first < last ){
+                status = cart->programWordBuffer(address + ( ( first - count ) << 1 ), &buf[first], last - first);
+                if( ( status == umdv1::STATUS_FAIL ) || ( status == umdv1::STATUS_TIMEOUT ) ){
+                    success = false;
+                }else{
+                    // data polling only checked the last word of the buffer
+                    for( i = first; i < last; i++ ){
+                        if( cart->readWord( address + ( ( i - count ) << 1 ) ) != buf[i] ){
+                            programFailed( address + ( ( i - count ) << 1 ) );
+                        }
+                    }
+                }
+            }
+            address += ( words << 1 );
+            count += words;
+        }
+    }
+
+    return success;
+}
+
+/*******************************************************************//**
+ *  \brief Record an address that read back wrong after programming,
+ *         only the first BIN_PROGRAM_MAX_FAILS are kept
+ *  \param address 24bit address
+ *  \return Void
+ **********************************************************************/
+void programFailed(uint32_t address)
+{
+    if( programFailCount < BIN_PROGRAM_MAX_FAILS ){
+        programFails[programFailCount] = address;
+    }
+    programFailCount++;
+}
+
+/*******************************************************************//**
+ *  \brief Start receiving a block into half of dataBuffer, the bytes
+ *         are collected by rxPump() and rxFinish()
+ *  \param half where the block goes
+ *  \param size number of bytes expected
+ *  \return Void
+ **********************************************************************/
+void rxBegin(char *half, uint16_t size)
+{
+    rxHalf = half;
+    rxCount = 0;
+    rxSize = size;
+}
+
+/*******************************************************************//**
+ *  \brief Collect the bytes that already arrived, at most 16 so the
+ *         flash status polling this runs from isn't held up
+ *  \return Void
+ **********************************************************************/
+void rxPump()
+{
+    uint8_t n = 16;
+
+    while( n-- && ( rxCount < rxSize ) && Serial.available() ){
+        rxHalf[rxCount++] = rxMirror ? cart->mirror_byte(Serial.read()) : Serial.read();
+    }
+}
+
+/*******************************************************************//**
+ *  \brief Wait for the rest of the block started with rxBegin()
+ *  \return Void
+ **********************************************************************/
+void rxFinish()
+{
+    while( rxCount < rxSize ){
+        rxPump();
+    }
+}
+
+/*******************************************************************//**
+ *  \brief Get sfPump() ready to read an image file from the serial
+ *         flash, compressed or raw
+ *  \param file the open image file
+ *  \return image size, the uncompressed size of a compressed image
+ **********************************************************************/
+uint32_t sfOpen(SerialFlashFile &file)
+{
+    bin_image_t image;
+
+    sfSource = file.getFlashAddress();
+    sfCompressed = false;
+    sfLeft = file.size();
+
+    if( file.size() >= sizeof(image) )
+    {
+        SerialFlash.read(sfSource, &image, sizeof(image));
+        if( image.magic == BIN_IMAGE_MAGIC )
+        {
+            sfSource += sizeof(image);
+            sfCompressed = true;
+            sfLeft = image.length;
+            sfStages = 0;
+            sfStagePos = 0;
+        }
+    }
+
+    return sfLeft;
+}
+
+/*******************************************************************//**
+ *  \brief Like rxPump() but the block started with rxBegin() comes from
+ *         the serial flash at sfSource, 16 bytes at a time. A
+ *         compressed image is expanded on the way, see bin_rle_e.
+ *  \return Void
+ **********************************************************************/
+void sfPump()
+{
+    uint8_t token[3];
+    uint16_t count = rxSize - rxCount;
+
+    if( count > 16 )
+    {
+        count = 16;
+    }
+    if( count == 0 )
+    {
+        return;
+    }
+
+    if( !sfCompressed )
+    {
+        SerialFlash.read(sfSource, &rxHalf[rxCount], count);
+        sfSource += count;
+        rxCount += count;
+        return;
+    }
+
+    // only BIN_RLE_FILL has the third byte
+    if( sfStages == 0 )
+    {
+        SerialFlash.read(sfSource, token, sizeof(token));
+        sfToken = token[0];
+        sfStages = token[1];
+        sfFill = token[2];
+        sfSource += ( sfToken == BIN_RLE_FILL ) ? 3 : 2;
+        return;
+    }
+
+    if( sfStagePos == 0 )
+    {
+        sfStageSize = ( sfLeft > BIN_RLE_STAGE_SIZE ) ? BIN_RLE_STAGE_SIZE : (uint8_t)sfLeft;
+    }
+    if( count > ( sfStageSize - sfStagePos ) )
+    {
+        count = sfStageSize - sfStagePos;
+    }
+
+    switch( sfToken )
+    {
+        case BIN_RLE_LITERAL:
+            SerialFlash.read(sfSource, &sfStage[sfStagePos], count);
+            sfSource += count;
+            break;
+        case BIN_RLE_FILL:
+            memset(&sfStage[sfStagePos], sfFill, count);
+            break;
+        default:
+            // BIN_RLE_REPEAT, sfStage still holds the previous stage
+            break;
+    }
+    memcpy(&rxHalf[rxCount], &sfStage[sfStagePos], count);
+    rxCount += count;
+    sfLeft -= count;
+    sfStagePos += count;
+
+    if( sfStagePos == sfStageSize )
+    {
+        sfStagePos = 0;
+        sfStages--;
+    }
+}
+
+/*******************************************************************//**
+ *  \brief Read the rest of the block started with rxBegin()
+ *  \return Void
+ **********************************************************************/
+void sfFinish()
+{
+    while( rxCount < rxSize ){
+        sfPump();
+    }
+}
+
+/*******************************************************************//**
+ *  \brief Program the cartridge from the serial flash, the next block is
+ *         read into the other half of dataBuffer while the flash is
+ *         busy programming the current one
+ *  Reads from sfSource, see sfOpen().
+ *  \param address 24bit cartridge address
+ *  \param size number of bytes
+ *  \param blockSize bytes per block, at most half of dataBuffer
+ *  \param progress print the bytes done after every block
+ *  \return false when a program failed or timed out
+ **********************************************************************/
+bool sfBurn(uint32_t address, uint32_t size, uint16_t blockSize, bool progress)
+{
+    uint32_t timer, pos = 0;
+    uint16_t count;
+    char *half = dataBuffer.byte;
+    bool success = true;
+
+    if( ( blockSize == 0 ) || ( blockSize > ( DATA_BUFFER_SIZE / 2 ) ) )
+    {
+        blockSize = DATA_BUFFER_SIZE / 2;
+    }
+
+    rxBegin(half, ( size > blockSize ) ? blockSize : (uint16_t)size);
+    sfFinish();
+    count = rxSize;
+
+    timer = millis();
+    while( success && ( pos < size ) )
+    {
+        if( millis() - timer > 250 )
+        {
+            digitalWrite(cart->nLED, !digitalRead(cart->nLED));
+            timer = millis();
+        }
+
+        rxBegin( ( half == dataBuffer.byte ) ? &dataBuffer.byte[DATA_BUFFER_SIZE / 2] : dataBuffer.byte,
+            ( ( size - pos - count ) > blockSize ) ? blockSize : (uint16_t)( size - pos - count ) );
+
+        cart->pollIdle = sfPump;
+        if( cart->info.bus_size == 16 )
+        {
+            success = burnWordBlock(address + pos, count, (uint16_t *)half);
+        }else
+        {
+            success = burnByteBlock(address + pos, count, (uint8_t *)half);
+        }
+        cart->pollIdle = NULL;
+        sfFinish();
+
+        pos += count;
+        if( progress )
+        {
+            Serial.println(pos, DEC);
+        }
+        count = rxSize;
+        half = rxHalf;
+    }
+
+    return success;
+}
+
+/*******************************************************************//**
+ *  \brief Find room to stage an upload at the top of the serial flash,
+ *         above every file so the file system never sees it
+ *  \param size bytes of the upload
+ *  \return bytes that will be staged, less than size when the serial
+ *          flash doesn't have the room, 0 without a serial flash
+ **********************************************************************/
+uint32_t stageOpen(uint32_t size)
+{
+    SerialFlashFile file;
+    char fileName[13];      //Max filename length (8.3 plus a null char terminator)
+    uint32_t fileSize, block, used, room;
+
+    stageClean(true);
+    stageWanted = 0;
+    stageGranted = 0;
+    stageCount = 0;
+    stageErased = 0;
+
+    if( sfSize == 0 )
+    {
+        return 0;
+    }
+
+    // the directory is in the first block, files are packed above it
+    block = SerialFlash.blockSize();
+    used = block;
+    SerialFlash.opendir();
+    while( SerialFlash.readdir(fileName, sizeof(fileName), fileSize) )
+    {
+        file = SerialFlash.open(fileName);
+        if( ( file.getFlashAddress() + fileSize ) > used )
+        {
+            used = file.getFlashAddress() + fileSize;
+        }
+        file.close();
+    }
+    used = ( used + block - 1 ) & ~( block - 1 );
+    room = ( sfSize > used ) ? ( sfSize - used ) : 0;
+
+    stageWanted = ( size > room ) ? room : size;
+    stageBase = sfSize - ( ( stageWanted + block - 1 ) & ~( block - 1 ) );
+    return stageWanted;
+}
+
+/*******************************************************************//**
+ *  \brief pollIdle while a BIN_FLAG_ERASE erase runs, move every block
+ *         received into the serial flash and grant the next credit, use
+ *         the idle time of the serial flash to erase ahead
+ *  \return Void
+ **********************************************************************/
+void stagePump()
+{
+    rxPump();
+
+    // never wait on the serial flash, the erase may be done
+    if( !SerialFlash.ready() )
+    {
+        return;
+    }
+
+    if( ( rxSize > 0 ) && ( rxCount == rxSize ) && ( ( stageCount + rxSize ) <= stageErased ) )
+    {
+        SerialFlash.write(stageBase + stageCount, rxHalf, rxSize);
+        stageCount += rxSize;
+
+        if( stageGranted < stageWanted )
+        {
+            Serial.write((uint8_t)1);
+            Serial.send_now();
+            stageGranted += ( ( stageWanted - stageGranted ) > BIN_CREDIT_SIZE ) ? BIN_CREDIT_SIZE : ( stageWanted - stageGranted );
+        }
+        rxBegin(rxHalf, ( ( stageGranted - stageCount ) > BIN_CREDIT_SIZE ) ? BIN_CREDIT_SIZE : (uint16_t)( stageGranted - stageCount ));
+    }else if( stageErased < stageWanted )
+    {
+        SerialFlash.eraseBlock(stageBase + stageErased);
+        stageErased += SerialFlash.blockSize();
+    }
+}
+
+/*******************************************************************//**
+ *  \brief Erase a range while the upload is staged in the serial flash,
+ *         then program what was staged
+ *  The credits go out as fast as the serial flash takes the blocks so
+ *  the upload runs during the erase instead of after it. Whatever didn't
+ *  fit is left to the regular BIN_OP_PROGSTREAM loop, stageCount bytes
+ *  were taken.
+ *  \param address 24bit start address
+ *  \param size bytes of the upload, the range to erase
+ *  \return false when the erase or the programming failed
+ **********************************************************************/
+bool stageProgram(uint32_t address, uint32_t size)
+{
+    uint32_t block;
+    bool success;
+
+    if( stageOpen(size) > 0 )
+    {
+        stageGranted = ( stageWanted > 2*BIN_CREDIT_SIZE ) ? 2*BIN_CREDIT_SIZE : stageWanted;
+        Serial.write((uint8_t)( ( stageGranted + BIN_CREDIT_SIZE - 1 ) / BIN_CREDIT_SIZE ));
+        Serial.send_now();
+    }
+    rxBegin(dataBuffer.byte, ( stageGranted > BIN_CREDIT_SIZE ) ? BIN_CREDIT_SIZE : (uint16_t)stageGranted);
+
+    cart->pollIdle = stagePump;
+    success = eraseRange(address, size, false);
+    cart->pollIdle = NULL;
+
+    // no more credits, collect the blocks already granted
+    stageWanted = stageGranted;
+    while( stageCount < stageGranted )
+    {
+        stagePump();
+    }
+
+    if( stageCount > 0 )
+    {
+        block = SerialFlash.blockSize();
+        stageDirty = ( stageCount + block - 1 ) & ~( block - 1 );
+    }
+
+    if( success && ( stageCount > 0 ) )
+    {
+        sfSource = stageBase;
+        sfCompressed = false;
+        success = sfBurn(address, stageCount, DATA_BUFFER_SIZE / 2, false);
+    }
+
+    return success;
+}
+
+/*******************************************************************//**
+ *  \brief Erase the serial flash blocks of the last staged upload, the
+ *         file system expects its free space to read 0xFF
+ *  \param wait block until everything is erased, else only start the
+ *         next block erase when the serial flash is idle
+ *  \return Void
+ **********************************************************************/
+void stageClean(bool wait)
+{
+    while( stageDirty > 0 )
+    {
+        if( !SerialFlash.ready() )
+        {
+            if( !wait )
+            {
+                return;
+            }
+            continue;
+        }
+        stageDirty -= SerialFlash.blockSize();
+        SerialFlash.eraseBlock(stageBase + stageDirty);
+    }
+
+    while( wait && !SerialFlash.ready() );
+}
+
+/*******************************************************************//**
+ *  \brief Read the onboard serial flash ID
+ *  \return Void
+ **********************************************************************/
+void sfGetID()
+{
+    //W25Q128FVSIG
+    Serial.write(sfID[0]);
+    Serial.write(sfID[1]);
+    Serial.write(sfID[2]);
+    Serial.write(sfID[3]);
+    Serial.write(sfID[4]);
+}
+
+
+/*******************************************************************//**
+ *  \brief Get the size of the onboard serial flash
+ *  \return Void
+ **********************************************************************/
+void sfGetSize()
+{
+    //W25Q128FVSIG
+    Serial.println(sfSize,DEC);
+}
+
+/*******************************************************************//**
+ *  \brief Erase the serial flash
+ *  \return Void
+ **********************************************************************/
+void sfEraseAll()
+{
+    char *arg;
+
+    // nothing staged survives this
+    stageDirty = 0;
+
+    arg = SCmd.next();
+    if( arg != NULL )
+    {
+        switch(*arg)
+        {
+            //wait for operation to complete, measure time
+            case 'w':
+                SerialFlash.eraseAll();
+                while (SerialFlash.ready() == false) {
+                    // wait, 30 seconds to 2 minutes for most chips
+                    digitalWrite(cart->nLED, LOW);
+                    delay(250);
+                    digitalWrite(cart->nLED, HIGH);
+                    delay(250);
+                    Serial.print(".");
+                }
+                Serial.print("!");
+                break;
+            default:
+                break;
+        }
+    }else
+    {
+        SerialFlash.eraseAll();
+    }
+}
+
+/*******************************************************************//**
+ *  \brief Burn a file from the serial flash to the cartridge
+ *  
+ *  Usage:
+ *  sflburn rom.bin
+ *  
+ *  \return Void
+ **********************************************************************/
+void sfBurnCart()
+{
+    char *arg;
+    uint16_t blockSize, i;
+    uint32_t fileSize;
+    bool success = true;
+    char fileName[13];      //Max filename length (8.3 plus a null char terminator)
+    
+    //get the file name
+    arg = SCmd.next();
+    i = 0;
+    while( (*arg != 0) && ( i < 12) )
+    {
+        fileName[i++] = *(arg++);
+    }
+    fileName[i] = 0; //null char terminator
+    
+        //get the read block size
+    arg = SCmd.next();
+    blockSize = strtoul(arg, (char**)0, 0);
+
+    flashFile = SerialFlash.open(fileName);
+    if (flashFile)
+    {
+        Serial.println(F("found"));
+        fileSize = sfOpen(flashFile);
+        Serial.println(fileSize,DEC);
+        
+        // select buffered programming
+        cart->getFlashID();
+        programFailCount = 0;
+        
+        success = sfBurn(0, fileSize, blockSize, true) && ( programFailCount == 0 );
+        if( success )
+        {
+            Serial.println(F("done"));
+        }else
+        {
+            Serial.println(F("error"));
+        }
+    }else
+    {
+        Serial.println(F("error"));
+    }
+    
+    flashFile.close();
+    digitalWrite(cart->nLED, HIGH);
+}
+
+/*******************************************************************//**
+ *  \brief Burn a file from the serial flash to the cartridge
+ *  
+ *  Usage:
+ *  sflburn rom.bin
+ *  
+ *  \return Void
+ **********************************************************************/
+void sfEraseCartBurnAuto(uint16_t blockSize)
+{
+    uint32_t fileSize = 0;
+    bool success;
+    
+    digitalWrite(cart->nLED, LOW);
+    cart->getFlashID();
+    programFailCount = 0;
+    flashFile = SerialFlash.open("auto");
+
+    // new carts come blank, only erase what the range to burn needs
+    if( !flashFile )
+    {
+        cart->eraseChip(true);
+    }else
+    {
+        fileSize = sfOpen(flashFile);
+        if( ( blankCheck(0, fileSize, false) != BLANK ) && !eraseRange(0, fileSize, false) )
+        {
+            // don't burn over flash that isn't erased
+            flash_led(4, 500);
+            flashFile.close();
+            return;
+        }
+    }
+    
+    // flash to signal erase is complete
+    flash_led(4, 100);
+
+    if (flashFile){
+        success = sfBurn(0, fileSize, blockSize, false) && ( programFailCount == 0 );
+        flash_led(4, success ? 100 : 500);
+    }else{
+        flash_led(4, 500);
+    }
+    
+    flashFile.close();
+}
+
+
+/*******************************************************************//**
+ *  \brief Read a file from the serial flash
+ *  
+ *  Usage:
+ *  sflread file.bin
+ *  
+ *  \return Void
+ **********************************************************************/
+void sfReadFile()
+{
+    char *arg;
+    uint16_t blockSize, i;
+    uint32_t fileSize, pos=0;
+    char fileName[13];      //Max filename length (8.3 plus a null char terminator)
+    
+    //get the file name
+    arg = SCmd.next();
+    i = 0;
+    while( (*arg != 0) && ( i < 12) )
+    {
+        fileName[i++] = *(arg++);
+    }
+    fileName[i] = 0; //null char terminator
+    
+    //get the read block size
+    arg = SCmd.next();
+    blockSize = strtoul(arg, (char**)0, 0);
+    if( blockSize > DATA_BUFFER_SIZE )
+    {
+        blockSize = DATA_BUFFER_SIZE;
+    }
+    
+    digitalWrite(cart->nLED, LOW);
+    
+    flashFile = SerialFlash.open(fileName);
+    if (flashFile)
+    {
+        Serial.println(F("found"));
+        fileSize = flashFile.size();
+        Serial.println(fileSize,DEC);
+        
+        while( pos < fileSize )
+        {
+            //don't send anything past the end of the file
+            if( ( fileSize - pos ) < blockSize )
+            {
+                blockSize = fileSize - pos;
+            }
+            flashFile.read(dataBuffer.byte, blockSize);
+            
+            // USB write blocks while the host is behind, no need to pace it
+            Serial.write(dataBuffer.byte, blockSize);
+            
+            pos += blockSize;
+        }
+        Serial.send_now();
+
+    }else
+    {
+        Serial.println(F("error"));
+    }
+    flashFile.close();
+    
+    digitalWrite(cart->nLED, HIGH);
+}
+
+/*******************************************************************//**
+ *  \brief Write a file to the serial flash
+ *  
+ *  Usage:
+ *  sflwrite rom.bin 4096 2048 xx[0] xx[1] ... xx[2047] /wait/ ... xx[4095] 
+ *  Filename must be 12 chars or less (8.3)
+ * 
+ *  \return Void
+ **********************************************************************/
+void sfWriteFile()
+{
+    char *arg;
+    uint16_t i, count, size, blockSize;
+    uint32_t fileSize, pos=0;
+    char fileName[13];      //Max filename length (8.3 plus a null char terminator)
+
+    //get the file name
+    arg = SCmd.next();
+    i = 0;
+    while( (*arg != 0) && ( i < 12) )
+    {
+        fileName[i++] = *(arg++);
+    }
+    fileName[i] = 0; //null char terminator
+
+    //get the size in the next argument
+    arg = SCmd.next();
+    fileSize = strtoul(arg, (char**)0, 0);
+    
+    //get the blockSize in the next argument
+    arg = SCmd.next();
+    blockSize = strtoul(arg, (char**)0, 0);
+    
+    digitalWrite(cart->nLED, LOW);
+    
+    Serial.read(); //there's an extra byte here for some reason - discard
+
+    // the new file may land where the last upload was staged
+    stageClean(true);
+    SerialFlash.create(fileName, fileSize);
+    flashFile = SerialFlash.open(fileName);
+    while( pos < fileSize )
+    {
+        // the last block is short, compressed images are any size
+        size = ( ( fileSize - pos ) > blockSize ) ? blockSize : (uint16_t)( fileSize - pos );
+
+        // fill buffer from USB
+        count = 0;
+        while( count < size )
+        {
+            if( Serial.available() )
+            {
+                dataBuffer.byte[count++] = Serial.read();
+            }
+        }
+        // write buffer to serial flash file
+        flashFile.write(dataBuffer.byte, size);
+        pos += size;
+        Serial.println(F("rdy"));
+    }
+    flashFile.close();
+    
+    digitalWrite(cart->nLED, HIGH);
+}
+
+/*******************************************************************//**
+ *  \brief List Files in the Serial Flash
+ *  
+ *  Usage:
+ *  sfllist
+ *  
+ *  \return Void
+ **********************************************************************/
+void sfListFiles()
+{
+    //W25Q128FVSIG
+    char fileName[64];
+    uint32_t fileSize;
+    
+    digitalWrite(cart->nLED, LOW);
+    
+    SerialFlash.opendir();
+    while (1) {
+        if (SerialFlash.readdir(fileName, sizeof(fileName), fileSize))
+        {
+          Serial.print(fileName);
+          Serial.print(";");
+          Serial.print(fileSize, DEC);
+          Serial.print(",");
+        }else 
+        {
+            Serial.println();
+            break; // no more files
+        }
+    }
+    
+    digitalWrite(cart->nLED, HIGH);
+}
+
+/*******************************************************************//**
+ *  \brief Verify cartridge against a serial flash file
+ *  
+ *  Usage:
+ *  sfverify file.bin
+ *  
+ *  \return Void
+ **********************************************************************/
+void sfVerify()
+{
+    char *arg;
+    uint8_t readByte;
+    uint16_t i=0, readWord, count;
+    uint32_t fileSize, pos=0;
+    char fileName[13];      //Max filename length (8.3 plus a null char terminator)
+    
+    //get the file name
+    arg = SCmd.next();
+    i = 0;
+    while( (*arg != 0) && ( i < 12) )
+    {
+        fileName[i++] = *(arg++);
+    }
+    fileName[i] = 0; //null char terminator
+    
+    digitalWrite(cart->nLED, LOW);
+    
+    flashFile = SerialFlash.open(fileName);
+    if (flashFile)
+    {
+        Serial.println(F("found"));
+        fileSize = sfOpen(flashFile);
+        Serial.println(fileSize,DEC);
+        
+        while( pos < fileSize )
+        {
+            count = ( ( fileSize - pos ) > DATA_BUFFER_SIZE ) ? DATA_BUFFER_SIZE : (uint16_t)( fileSize - pos );
+            rxBegin(dataBuffer.byte, count);
+            sfFinish();
+            
+            if( cart->info.bus_size == 16 )
+            {
+                for( i = 0; i < count/2 ; i++ )
+                {
+                    readWord = cart->readWord(pos);
+                    if( dataBuffer.word[i] != readWord )
+                    {
+                        //throw some error
+                        Serial.print("$");
+                        Serial.println(pos, DEC);
+                        Serial.println(dataBuffer.word[i], DEC);
+                        Serial.println(readWord, DEC);
+                    }
+                    pos += 2;
+                }
+            }else
+            {
+                for( i = 0; i < count; i++ )
+                {
+                    readByte = cart->readByte(pos);
+                    if( (uint8_t)dataBuffer.byte[i] != readByte )
+                    {
+                        //throw some error
+                        Serial.print("$");
+                        Serial.println(pos, DEC);
+                        Serial.println(dataBuffer.byte[i], DEC);
+                        Serial.println(readByte, DEC);
+                    }
+                    pos++;
+                }
+                
+            }
+            
+            //PC side app expects a "." before timeout
+            Serial.print(".");
+        }
+
+    }else
+    {
+        Serial.println(F("error"));
+    }
+    
+    flashFile.close();
+    
+    //Send something other than a "." to indicate we are done
+    Serial.print("!");
+    
+    digitalWrite(cart->nLED, HIGH);
+}
+
+/*******************************************************************//**
+ *  \brief Switch to the binary framed protocol
+ *  Answers "binary" and then only accepts bin_header_t framed commands,
+ *  dispatched through binHandlers, until BIN_OP_EXIT is received.
+ *  
+ *  Usage:
+ *  binmode
+ *  
+ *  \return Void
+ **********************************************************************/
+void _binaryMode()
+{
+    bin_header_t hdr;
+
+    Serial.println(F("binary"));
+    Serial.send_now();
+
+    binActive = true;
+    while( binActive )
+    {
+        if( !Serial.available() )
+        {
+            stageClean(false);
+            continue;
+        }
+
+        // anything before the sync byte is dropped, such as the line feed following "binmode\r"
+        if( Serial.read() != BIN_SYNC )
+        {
+            continue;
+        }
+
+        hdr.sync = BIN_SYNC;
+        if( Serial.readBytes((char *)&hdr.opcode, sizeof(hdr) - 1) != ( sizeof(hdr) - 1 ) )
+        {
+            binRespond(&hdr, BIN_ERR_TIMEOUT, 0);
+        }else if( hdr.opcode < BIN_OP_COUNT )
+        {
+            binHandlers[hdr.opcode](&hdr);
+        }else
+        {
+            binRespond(&hdr, BIN_ERR_OPCODE, 0);
+        }
+    }
+
+    SCmd.clearBuffer();
+}
+
+/*******************************************************************//**
+ *  \brief Send a binary response header, the caller sends the payload
+ *  \param hdr the command being answered
+ *  \param status bin_status_e
+ *  \param length payload length which will follow
+ *  \return Void
+ **********************************************************************/
+void binRespond(const bin_header_t *hdr, uint8_t status, uint32_t length)
+{
+    bin_response_t resp;
+
+    resp.sync = BIN_SYNC;
+    resp.opcode = hdr->opcode;
+    resp.status = status;
+    resp.seq = hdr->seq;
+    resp.length = length;
+    Serial.write((const char *)&resp, sizeof(resp));
+
+    if( length == 0 )
+    {
+        Serial.send_now();
+    }
+}
+
+/*******************************************************************//**
+ *  \brief BIN_OP_PING
+ **********************************************************************/
+void binPing(bin_header_t *hdr)
+{
+    binRespond(hdr, BIN_OK, 0);
+}
+
+/*******************************************************************//**
+ *  \brief BIN_OP_SETMODE, address holds the console mode
+ **********************************************************************/
+void binSetMode(bin_header_t *hdr)
+{
+    if( hdr->address > cf.getMaxCartMode() )
+    {
+        binRespond(hdr, BIN_ERR_MODE, 0);
+        return;
+    }
+
+    cart = cf.getCart(static_cast<umdv1::console_e>(hdr->address));
+    cart->setup(0);
+    binRespond(hdr, BIN_OK, 0);
+}
+
+/*******************************************************************//**
+ *  \brief BIN_OP_GETID, query the flash and return all of its info
+ **********************************************************************/
+void binGetID(bin_header_t *hdr)
+{
+    bin_flashid_t id;
+
+    if( cart == NULL )
+    {
+        binRespond(hdr, BIN_ERR_MODE, 0);
+        return;
+    }
+
+    digitalWrite(cart->nLED, LOW);
+    cart->getFlashID();
+    digitalWrite(cart->nLED, HIGH);
+
+    id.manufacturer = cart->flashID.manufacturer;
+    id.device = cart->flashID.device;
+    id.type = cart->flashID.type;
+    id.buffermode = cart->flashID.buffermode;
+    id.size = cart->flashID.size;
+
+    binRespond(hdr, BIN_OK, sizeof(id));
+    Serial.write((const char *)&id, sizeof(id));
+    Serial.send_now();
+}
+
+/*******************************************************************//**
+ *  \brief BIN_OP_ROMSIZE
+ **********************************************************************/
+void binRomSize(bin_header_t *hdr)
+{
+    uint32_t romSize;
+
+    if( cart == NULL )
+    {
+        binRespond(hdr, BIN_ERR_MODE, 0);
+        return;
+    }
+
+    romSize = cart->getRomSize();
+    binRespond(hdr, BIN_OK, sizeof(romSize));
+    Serial.write((const char *)&romSize, sizeof(romSize));
+    Serial.send_now();
+}
+
+/*******************************************************************//**
+ *  \brief BIN_OP_ERASE, the response is sent once the erase completes
+ **********************************************************************/
+void binErase(bin_header_t *hdr)
+{
+    bool success;
+
+    if( cart == NULL )
+    {
+        binRespond(hdr, BIN_ERR_MODE, 0);
+        return;
+    }
+
+    // same as eraseChip(true) but without the text progress
+    digitalWrite(cart->nLED, LOW);
+    success = eraseRange(0, 0, false);
+    digitalWrite(cart->nLED, HIGH);
+
+    binRespond(hdr, success ? BIN_OK : BIN_ERR_FLASH, 0);
+}
+
+/*******************************************************************//**
+ *  \brief BIN_OP_READ, stream length bytes starting at address
+ **********************************************************************/
+void binRead(bin_header_t *hdr)
+{
+    if( cart == NULL )
+    {
+        binRespond(hdr, BIN_ERR_MODE, 0);
+        return;
+    }
+
+    digitalWrite(cart->nLED, LOW);
+    binRespond(hdr, BIN_OK, hdr->length);
+
+    if( hdr->flags & BIN_FLAG_SRAM )
+    {
+        cart->enableSram(0);
+    }
+    if( hdr->flags & BIN_FLAG_RLE )
+    {
+        rleBegin();
+    }
+    if( hdr->flags & BIN_FLAG_CRC )
+    {
+        crcBegin();
+    }
+
+    if( cart->info.bus_size == 16 )
+    {
+        sendWordBlock(hdr->address, hdr->length);
+    }else
+    {
+        sendByteBlock(hdr->address, hdr->length);
+    }
+
+    if( hdr->flags & BIN_FLAG_RLE )
+    {
+        rleEnd();
+    }
+    if( hdr->flags & BIN_FLAG_CRC )
+    {
+        crcEnd();
+    }
+    if( hdr->flags & BIN_FLAG_SRAM )
+    {
+        cart->disableSram(0);
+    }
+
+    digitalWrite(cart->nLED, HIGH);
+}
+
+/*******************************************************************//**
+ *  \brief Drop the payload of a rejected binary command to keep the
+ *  stream in sync with the next header
+ *  \param count number of payload bytes
+ *  \return Void
+ **********************************************************************/
+void binDiscard(uint32_t count)
+{
+    while( count > 0 )
+    {
+        while( !Serial.available() );
+        Serial.read();
+        count--;
+    }
+}
+
+/*******************************************************************//**
+ *  \brief Receive the payload of a binary command into dataBuffer
+ *  \return false if the payload does not fit, it is then discarded
+ **********************************************************************/
+bool binReceive(bin_header_t *hdr)
+{
+    if( hdr->length > DATA_BUFFER_SIZE )
+    {
+        binDiscard(hdr->length);
+        return false;
+    }
+
+    receiveBlock((uint16_t)hdr->length, ( cart != NULL ) && cart->info.mirrored_bus);
+    return true;
+}
+
+/*******************************************************************//**
+ *  \brief BIN_OP_PROGRAM, program the payload at address, with
+ *  BIN_FLAG_VERIFY the response lists what read back wrong
+ **********************************************************************/
+void binProgram(bin_header_t *hdr)
+{
+    bool success;
+    uint8_t listed;
+
+    if( !binReceive(hdr) )
+    {
+        binRespond(hdr, BIN_ERR_LENGTH, 0);
+        return;
+    }
+    if( cart == NULL )
+    {
+        binRespond(hdr, BIN_ERR_MODE, 0);
+        return;
+    }
+
+    programFailCount = 0;
+    digitalWrite(cart->nLED, LOW);
+    if( cart->info.bus_size == 16 )
+    {
+        success = burnWordBlock(hdr->address, (uint16_t)hdr->length, dataBuffer.word);
+    }else
+    {
+        success = burnByteBlock(hdr->address, (uint16_t)hdr->length, (uint8_t *)dataBuffer.byte);
+    }
+    digitalWrite(cart->nLED, HIGH);
+
+    if( !success || !( hdr->flags & BIN_FLAG_VERIFY ) )
+    {
+        binRespond(hdr, success ? BIN_OK : BIN_ERR_FLASH, 0);
+        return;
+    }
+
+    // every byte/word was read back while its address was still latched
+    listed = ( programFailCount < BIN_PROGRAM_MAX_FAILS ) ? programFailCount : BIN_PROGRAM_MAX_FAILS;
+    binRespond(hdr, BIN_OK, sizeof(programFailCount) + listed * sizeof(programFails[0]));
+    Serial.write((const char *)&programFailCount, sizeof(programFailCount));
+    Serial.write((const char *)programFails, listed * sizeof(programFails[0]));
+    Serial.send_now();
+}
+
+/*******************************************************************//**
+ *  \brief BIN_OP_PROGSTREAM, program length bytes at address as they
+ *  arrive. The next block is received into one half of dataBuffer from
+ *  the flash status polling while the other half is programmed. After a
+ *  failure the rest of the payload is received and dropped.
+ **********************************************************************/
+void binProgramStream(bin_header_t *hdr)
+{
+    uint32_t address = hdr->address;
+    uint32_t remaining = hdr->length;
+    uint32_t blocks, granted;
+    uint16_t size;
+    char *half = dataBuffer.byte;
+    bool success = true;
+    uint8_t listed;
+
+    // the PC waits for a credit before sending anything
+    if( cart == NULL )
     {
-        fileName[i++] = *(arg++);
+        binRespond(hdr, BIN_ERR_MODE, 0);
+        return;
     }
-    fileName[i] = 0; //null char terminator
 
-    //get the size in the next argument
-    arg = SCmd.next();
-    fileSize = strtoul(arg, (char**)0, 0);
-    
-    //get the blockSize in the next argument
-    arg = SCmd.next();
-    blockSize = strtoul(arg, (char**)0, 0);
-    
+    programFailCount = 0;
+    rxMirror = cart->info.mirrored_bus;
     digitalWrite(cart->nLED, LOW);
-    
-    Serial.read(); //there's an extra byte here for some reason - discard
 
-    SerialFlash.create(fileName, fileSize);
-    flashFile = SerialFlash.open(fileName);
-    while( pos < fileSize )
+    // the start of the payload goes to the serial flash during the erase
+    if( hdr->flags & BIN_FLAG_ERASE )
     {
-        // fill buffer from USB
-        count = 0;
-        while( count < blockSize )
+        success = stageProgram(address, remaining);
+        address += stageCount;
+        remaining -= stageCount;
+    }
+
+    blocks = ( remaining + BIN_CREDIT_SIZE - 1 ) / BIN_CREDIT_SIZE;
+    granted = ( blocks < 2 ) ? blocks : 2;
+    if( granted )
+    {
+        Serial.write((uint8_t)granted);
+        Serial.send_now();
+    }
+
+    size = ( remaining > BIN_CREDIT_SIZE ) ? BIN_CREDIT_SIZE : (uint16_t)remaining;
+    rxBegin(half, size);
+    rxFinish();
+
+    while( remaining > 0 )
+    {
+        // receive the next block into the other half while this one burns
+        if( remaining > size )
         {
-            if( Serial.available() )
+            rxBegin( ( half == dataBuffer.byte ) ? &dataBuffer.byte[BIN_CREDIT_SIZE] : dataBuffer.byte,
+                ( ( remaining - size ) > BIN_CREDIT_SIZE ) ? BIN_CREDIT_SIZE : (uint16_t)( remaining - size ) );
+        }else
+        {
+            rxBegin(half, 0);
+        }
+
+        if( success )
+        {
+            cart->pollIdle = rxPump;
+            if( cart->info.bus_size == 16 )
             {
-                dataBuffer.byte[count++] = Serial.read();
+                success = burnWordBlock(address, size, (uint16_t *)half);
+            }else
+            {
+                success = burnByteBlock(address, size, (uint8_t *)half);
             }
+            cart->pollIdle = NULL;
         }
-        // write buffer to serial flash file
-        flashFile.write(dataBuffer.byte, blockSize);
-        pos += blockSize;
-        Serial.println(F("rdy"));
+
+        // this half is free again
+        if( granted < blocks )
+        {
+            Serial.write((uint8_t)1);
+            Serial.send_now();
+            granted++;
+        }
+
+        rxFinish();
+        address += size;
+        remaining -= size;
+        size = rxSize;
+        half = rxHalf;
     }
-    flashFile.close();
-    
     digitalWrite(cart->nLED, HIGH);
+
+    if( !success || !( hdr->flags & BIN_FLAG_VERIFY ) )
+    {
+        binRespond(hdr, success ? BIN_OK : BIN_ERR_FLASH, 0);
+        return;
+    }
+
+    listed = ( programFailCount < BIN_PROGRAM_MAX_FAILS ) ? programFailCount : BIN_PROGRAM_MAX_FAILS;
+    binRespond(hdr, BIN_OK, sizeof(programFailCount) + listed * sizeof(programFails[0]));
+    Serial.write((const char *)&programFailCount, sizeof(programFailCount));
+    Serial.write((const char *)programFails, listed * sizeof(programFails[0]));
+    Serial.send_now();
 }
 
 /*******************************************************************//**
- *  \brief List Files in the Serial Flash
- *  
- *  Usage:
- *  sfllist
- *  
- *  \return Void
+ *  \brief BIN_OP_WRITESRAM, write the payload to the SRAM at address
  **********************************************************************/
-void sfListFiles()
+void binWriteSram(bin_header_t *hdr)
 {
-    //W25Q128FVSIG
-    char fileName[64];
-    uint32_t fileSize;
-    
+    // SRAM is never mirrored, don't let binReceive reverse it
+    if( ( hdr->length > DATA_BUFFER_SIZE ) || ( cart == NULL ) )
+    {
+        binReceive(hdr);
+        binRespond(hdr, ( cart == NULL ) ? BIN_ERR_MODE : BIN_ERR_LENGTH, 0);
+        return;
+    }
+    receiveBlock((uint16_t)hdr->length, false);
+
     digitalWrite(cart->nLED, LOW);
-    
-    SerialFlash.opendir();
-    while (1) {
-        if (SerialFlash.readdir(fileName, sizeof(fileName), fileSize))
+    writeSramBlock(hdr->address, (uint16_t)hdr->length);
+    digitalWrite(cart->nLED, HIGH);
+
+    binRespond(hdr, BIN_OK, 0);
+}
+
+/*******************************************************************//**
+ *  \brief BIN_OP_EXIT, return to text commands
+ **********************************************************************/
+void binExit(bin_header_t *hdr)
+{
+    binActive = false;
+    binRespond(hdr, BIN_OK, 0);
+}
+
+/*******************************************************************//**
+ *  \brief BIN_OP_STREAM, stream length bytes starting at address in a
+ *  single command, BIN_CREDIT_SIZE bytes at a time as credits arrive
+ **********************************************************************/
+void binStream(bin_header_t *hdr)
+{
+    uint32_t address = hdr->address;
+    uint32_t remaining = hdr->length;
+    uint16_t credits = 0, count;
+
+    if( cart == NULL )
+    {
+        binRespond(hdr, BIN_ERR_MODE, 0);
+        return;
+    }
+
+    digitalWrite(cart->nLED, LOW);
+    binRespond(hdr, BIN_OK, hdr->length);
+
+    if( hdr->flags & BIN_FLAG_SRAM )
+    {
+        cart->enableSram(0);
+    }
+    if( hdr->flags & BIN_FLAG_RLE )
+    {
+        rleBegin();
+    }
+    if( hdr->flags & BIN_FLAG_CRC )
+    {
+        crcBegin();
+    }
+
+    while( remaining > 0 )
+    {
+        // collect credits, wait for some if the PC is behind
+        while( Serial.available() )
         {
-          Serial.print(fileName);
-          Serial.print(";");
-          Serial.print(fileSize, DEC);
-          Serial.print(",");
-        }else 
+            credits += (uint8_t)Serial.read();
+        }
+        if( credits == 0 )
         {
-            Serial.println();
-            break; // no more files
+            // the PC only grants credits for data it has decoded, don't sit on a run
+            if( rleEnabled && rleRunCount )
+            {
+                rleFlush();
+                Serial.send_now();
+            }
+            continue;
+        }
+
+        count = ( remaining > BIN_CREDIT_SIZE ) ? BIN_CREDIT_SIZE : (uint16_t)remaining;
+        if( cart->info.bus_size == 16 )
+        {
+            sendWordBlock(address, count);
+        }else
+        {
+            sendByteBlock(address, count);
         }
+
+        address += count;
+        remaining -= count;
+        credits--;
     }
-    
+
+    if( hdr->flags & BIN_FLAG_RLE )
+    {
+        rleEnd();
+    }
+    if( hdr->flags & BIN_FLAG_CRC )
+    {
+        crcEnd();
+    }
+    if( hdr->flags & BIN_FLAG_SRAM )
+    {
+        cart->disableSram(0);
+    }
+
     digitalWrite(cart->nLED, HIGH);
 }
 
 /*******************************************************************//**
- *  \brief Verify cartridge against a serial flash file
- *  
- *  Usage:
- *  sfverify file.bin
- *  
- *  \return Void
+ *  \brief BIN_OP_HASH, CRC-32 of length bytes starting at address and
+ *  the console checksum, nothing else goes over USB. A length of 0
+ *  hashes the ROM size from the header.
  **********************************************************************/
-void sfVerify()
+void binHash(bin_header_t *hdr)
 {
-    char *arg;
-    uint8_t readByte;
-    uint16_t i=0, readWord;
-    uint32_t fileSize, pos=0;
-    char fileName[13];      //Max filename length (8.3 plus a null char terminator)
-    
-    //get the file name
-    arg = SCmd.next();
-    i = 0;
-    while( (*arg != 0) && ( i < 12) )
+    bin_hash_t hash;
+
+    if( cart == NULL )
     {
-        fileName[i++] = *(arg++);
+        binRespond(hdr, BIN_ERR_MODE, 0);
+        return;
     }
-    fileName[i] = 0; //null char terminator
-    
+
+    hash.length = hdr->length;
+    if( ( hash.length == 0 ) && !( hdr->flags & BIN_FLAG_SRAM ) )
+    {
+        hash.length = cart->getRomSize();
+    }
+    if( hash.length == 0 )
+    {
+        binRespond(hdr, BIN_ERR_LENGTH, 0);
+        return;
+    }
+
     digitalWrite(cart->nLED, LOW);
-    
-    flashFile = SerialFlash.open(fileName);
-    if (flashFile)
+
+    if( hdr->flags & BIN_FLAG_SRAM )
     {
-        Serial.println(F("found"));
-        fileSize = flashFile.size();
-        Serial.println(fileSize,DEC);
-        
-        while( pos < fileSize )
+        cart->enableSram(0);
+        hash.crc32 = hashBlock(hdr->address, hash.length);
+        cart->disableSram(0);
+        hash.calculated = 0;
+        hash.expected = 0;
+    }else
+    {
+        hash.crc32 = hashBlock(hdr->address, hash.length);
+        cart->checksum.calculated = 0;
+        cart->checksum.expected = 0;
+        cart->quiet = true;
+        cart->calcChecksum();
+        cart->quiet = false;
+        hash.calculated = cart->checksum.calculated;
+        hash.expected = cart->checksum.expected;
+    }
+
+    digitalWrite(cart->nLED, HIGH);
+
+    binRespond(hdr, BIN_OK, sizeof(hash));
+    Serial.write((const char *)&hash, sizeof(hash));
+    Serial.send_now();
+}
+
+/*******************************************************************//**
+ *  \brief BIN_OP_VERIFY, compare length bytes starting at address
+ *  against the CRC-32 of every BIN_VERIFY_BLOCK_SIZE block sent as the
+ *  payload. The response payload is a bitmap with a bit set for every
+ *  block that does not match, it is sent as the blocks are checked so
+ *  the CRC table can be any size.
+ **********************************************************************/
+void binVerify(bin_header_t *hdr)
+{
+    uint32_t address = hdr->address;
+    uint32_t remaining = hdr->length;
+    uint32_t blocks = ( hdr->length + BIN_VERIFY_BLOCK_SIZE - 1 ) / BIN_VERIFY_BLOCK_SIZE;
+    uint32_t expected;
+    uint16_t count;
+    uint8_t bitmap = 0, bit = 0;
+
+    if( cart == NULL )
+    {
+        binDiscard(blocks * sizeof(expected));
+        binRespond(hdr, BIN_ERR_MODE, 0);
+        return;
+    }
+
+    digitalWrite(cart->nLED, LOW);
+    binRespond(hdr, BIN_OK, ( blocks + 7 ) / 8);
+
+    if( hdr->flags & BIN_FLAG_SRAM )
+    {
+        cart->enableSram(0);
+    }
+
+    while( remaining > 0 )
+    {
+        count = ( remaining > BIN_VERIFY_BLOCK_SIZE ) ? BIN_VERIFY_BLOCK_SIZE : (uint16_t)remaining;
+
+        // a missing CRC counts as a mismatch
+        if( ( Serial.readBytes((char *)&expected, sizeof(expected)) != sizeof(expected) ) ||
+            ( hashBlock(address, count) != expected ) )
         {
-            flashFile.read(dataBuffer.byte, DATA_BUFFER_SIZE);
-            
-            if( cart->info.bus_size == 16 )
-            {
-                for( i = 0; i < DATA_BUFFER_SIZE/2 ; i++ )
-                {
-                    readWord = cart->readWord(pos);
-                    if( dataBuffer.word[i] != readWord )
-                    {
-                        //throw some error
-                        Serial.print("$");
-                        Serial.println(pos, DEC);
-                        Serial.println(dataBuffer.word[i], DEC);
-                        Serial.println(readWord, DEC);
-                    }
-                    pos += 2;
-                }
-            }else
-            {
-                for( i = 0; i < DATA_BUFFER_SIZE; i++ )
-                {
-                    readByte = cart->readByte(pos);
-                    if( dataBuffer.byte[i] != readByte )
-                    {
-                        //throw some error
-                        Serial.print("$");
-                        Serial.println(pos, DEC);
-                        Serial.println(dataBuffer.byte[i], DEC);
-                        Serial.println(readByte, DEC);
-                    }
-                    pos++;
-                }
-                
-            }
-            
-            //PC side app expects a "." before timeout
-            Serial.print(".");
+            bitmap |= ( 1 << bit );
+        }
+
+        address += count;
+        remaining -= count;
+        if( ( ++bit == 8 ) || ( remaining == 0 ) )
+        {
+            Serial.write(bitmap);
+            bitmap = 0;
+            bit = 0;
         }
+    }
+    Serial.send_now();
+
+    if( hdr->flags & BIN_FLAG_SRAM )
+    {
+        cart->disableSram(0);
+    }
+
+    digitalWrite(cart->nLED, HIGH);
+}
+
+/*******************************************************************//**
+ *  \brief BIN_OP_BLANK, check that length bytes starting at address are
+ *  erased, a length of 0 checks the whole flash
+ **********************************************************************/
+void binBlank(bin_header_t *hdr)
+{
+    uint32_t size = hdr->length;
+    uint32_t result;
+
+    if( cart == NULL )
+    {
+        binRespond(hdr, BIN_ERR_MODE, 0);
+        return;
+    }
 
+    if( size == 0 )
+    {
+        cart->getFlashID();
+        size = cart->flashID.size;
+    }
+
+    // never call a range nobody checked blank, the PC erases the chip
+    if( size == 0 )
+    {
+        result = hdr->address;
     }else
     {
-        Serial.println(F("error"));
+        digitalWrite(cart->nLED, LOW);
+        result = blankCheck(hdr->address, size, false);
+        digitalWrite(cart->nLED, HIGH);
     }
-    
-    flashFile.close();
-    
-    //Send something other than a "." to indicate we are done
-    Serial.print("!");
-    
+
+    binRespond(hdr, BIN_OK, sizeof(result));
+    Serial.write((const char *)&result, sizeof(result));
+    Serial.send_now();
+}
+
+/*******************************************************************//**
+ *  \brief BIN_OP_ERASERANGE, erase the sectors covering length bytes
+ *  starting at address, the response is sent once the erase completes
+ **********************************************************************/
+void binEraseRange(bin_header_t *hdr)
+{
+    bool success;
+
+    if( cart == NULL )
+    {
+        binRespond(hdr, BIN_ERR_MODE, 0);
+        return;
+    }
+
+    digitalWrite(cart->nLED, LOW);
+    success = eraseRange(hdr->address, hdr->length, false);
     digitalWrite(cart->nLED, HIGH);
+
+    binRespond(hdr, success ? BIN_OK : BIN_ERR_FLASH, 0);
 }
@@ -43,17 +43,18 @@ void sms::setup(uint8_t alg)
     pinMode(nCE, OUTPUT);
     digitalWrite(nRD, HIGH);
 
-    // reset pulse
+    // reset pulse, the mapper comes back with its power on pages
     pinMode(SMS_nRST, OUTPUT);
     digitalWrite(SMS_nRST, LOW);
     delay(1);
     digitalWrite(SMS_nRST, HIGH);
+    SMS_SelectedPage = 0xFFFF;
+    SMS_SramConf = 0;
 
     //set default slot registers
     setSMSSlotRegister(1, (uint32_t)SMS_SLOT_1_ADDR);
     setSMSSlotRegister(2, (uint32_t)SMS_SLOT_2_ADDR);
 
-    SMS_SelectedPage = 2;
     info.console = SMS;
     info.mirrored_bus = false;
     info.bus_size = 8;
@@ -71,6 +72,8 @@ void sms::getFlashID(void)
     flashID.device = 0;
     flashID.type = 0;
     flashID.size = 0;
+    flashID.buffermode = 0;
+    flashID.bufferSize = 0;
     
     //set default slot registers
     setSMSSlotRegister(1, (uint32_t)SMS_SLOT_1_ADDR);
@@ -90,60 +93,98 @@ void sms::getFlashID(void)
     flashID.device = readByte16(0x0002);
     // exit software ID mode
     writeByte16(0x0000, 0xF0);
-    // figure out the size
-    flashID.size = getFlashSizeFromID(flashID.manufacturer, flashID.device);
+    // figure out the size, from the table for parts without CFI
+    if( !queryCFI() )
+    {
+        flashID.size = getFlashSizeFromID(flashID.manufacturer, flashID.device);
+    }
     
     // disable rom write enable bit
     romWrites(false);
 }
 
 /*******************************************************************//**
- * The calcChecksum() function calculates the word sum of all words
- * in the SMS cartridge
+ * The calcChecksum() function calculates the byte sum of the SMS
+ * cartridge. The header window is cut out of the range up front and each
+ * part is summed one 16KB page at a time with sumBank().
  **********************************************************************/
 void sms::calcChecksum()
 {
-    uint32_t address;
-    uint16_t timeOut = 0;
-    
     checksum.expected = (uint16_t)readByte((uint32_t)0x00007FFB);
     checksum.expected <<= 8;
     checksum.expected |= (uint16_t)readByte((uint32_t)0x00007FFA);
     checksum.romSize = getRomSize();
     
     checksum.calculated = 0;
-    address = 0;
     
-    while( address <= skipChecksumStart )
-    {
-        checksum.calculated += (uint16_t)readByte(address++);
-        
-        //PC side app expects a "." before timeout
-        if( timeOut++ > 0x3FFF )
-        {
-            timeOut = 0;
-            Serial.print(".");
-        }
-    }
+    sumRange(0, (uint32_t)skipChecksumStart + 1);
     
     //jump to end of header
+    sumRange(skipChecksumEnd, checksum.romSize);
     
-    address = skipChecksumEnd;
-    while( address < checksum.romSize )
+    //Send something other than a "." to indicate we are done
+    if( !quiet )
+    {
+        Serial.print("!");
+    }
+
+}
+
+/*******************************************************************//**
+ * The sumRange() function adds the bytes from start up to end to
+ * checksum.calculated, one page at a time
+ **********************************************************************/
+void sms::sumRange(uint32_t start, uint32_t end)
+{
+    uint32_t chunk;
+
+    while( start < end )
     {
-        checksum.calculated += (uint16_t)readByte(address++);
-        
+        chunk = ( SMS_SLOT_MASK + 1 ) - ( start & SMS_SLOT_MASK );
+        if( chunk > ( end - start ) )
+        {
+            chunk = end - start;
+        }
+
+        checksum.calculated += sumBank(start, (uint16_t)chunk);
+        start += chunk;
+
         //PC side app expects a "." before timeout
-        if( timeOut++ > 0x3FFF )
+        if( !quiet )
         {
-            timeOut = 0;
             Serial.print(".");
         }
     }
-    
-    //Send something other than a "." to indicate we are done
-    Serial.print("!");
+}
+
+/*******************************************************************//**
+ * The sumBank function returns the byte sum of count bytes starting at
+ * a 24bit address without crossing a 16KB page. The page is selected
+ * once by mapAddress() and the bytes are summed 4 per iteration.
+ **********************************************************************/
+uint16_t sms::sumBank(uint32_t address, uint16_t count)
+{
+    uint16_t virtualAddress;
+    uint16_t sum = 0;
+
+    virtualAddress = mapAddress(address);
+
+    while( count >= 4 )
+    {
+        sum += readSlot(virtualAddress);
+        sum += readSlot(virtualAddress + 1);
+        sum += readSlot(virtualAddress + 2);
+        sum += readSlot(virtualAddress + 3);
+        virtualAddress += 4;
+        count -= 4;
+    }
+
+    while( count-- )
+    {
+        sum += readSlot(virtualAddress++);
+    }
 
+    return sum;
 }
 
 /*******************************************************************//**
@@ -224,13 +265,7 @@ uint8_t sms::readByte(uint32_t address)
 
     uint8_t readData;
 
-    if(address < (uint32_t)SMS_SLOT_2_ADDR ){
-        latchAddress16((uint16_t)address);
-    }else{
-        //latch the address and set slot 2
-        setSMSSlotRegister(2, address);
-        latchAddress16(SMS_SLOT_2_ADDR | ((uint16_t)address & SMS_SLOT_MASK));
-    }
+    latchAddress16(mapAddress(address));
     
     SET_DATABUS_TO_INPUT();
     
@@ -252,6 +287,151 @@ uint8_t sms::readByte(uint32_t address)
     
 }
 
+/*******************************************************************//**
+ * The readByteBurst function reads count consecutive bytes starting at
+ * a 24bit address, one readBank() per 16KB page so the mapper is only
+ * written when the read crosses into the next page. With the SRAM
+ * enabled the pages are the SRAM banks.
+ **********************************************************************/
+void sms::readByteBurst(uint32_t address, uint8_t *buf, uint16_t count)
+{
+    uint16_t chunk;
+
+    while( count )
+    {
+        chunk = (uint16_t)( ( SMS_SLOT_MASK + 1 ) - ( address & SMS_SLOT_MASK ) );
+        if( chunk > count )
+        {
+            chunk = count;
+        }
+
+        readBank(address, buf, chunk);
+        address += chunk;
+        buf += chunk;
+        count -= chunk;
+    }
+}
+
+/*******************************************************************//**
+ * The readBank function reads count bytes starting at a 24bit address
+ * without crossing a 16KB page. The page is selected once by
+ * mapAddress() and the bytes are streamed through the slot, the low
+ * address latches are the only thing strobed per byte.
+ **********************************************************************/
+void sms::readBank(uint32_t address, uint8_t *buf, uint16_t count)
+{
+    uint16_t virtualAddress;
+
+    virtualAddress = mapAddress(address);
+
+    while( count-- )
+    {
+        *(buf++) = readSlot(virtualAddress++);
+    }
+}
+
+/*******************************************************************//**
+ * The readSlot function reads a byte from a 16bit address in the Z80
+ * address space, only the low address latches are strobed. The mapper
+ * must already hold the right page.
+ **********************************************************************/
+inline uint8_t sms::readSlot(uint16_t virtualAddress)
+{
+    uint8_t readData;
+
+    SET_DATABUS_TO_OUTPUT();
+    DATAOUTH = (uint8_t)(virtualAddress>>8 & 0xFF);
+    DATAOUTL = (uint8_t)(virtualAddress & 0xFF);
+    PORTALE |= ALE_low_setmask;
+    PORTALE &= ALE_low_clrmask;
+    SET_DATABUS_TO_INPUT();
+
+    PORTCE &= nCE_clrmask;
+    PORTRD &= nRD_clrmask;
+    PORTRD &= nRD_clrmask;
+    PORTRD &= nRD_clrmask; // wait an additional 62.5ns. ROM is slow;
+
+    readData = DATAINL;
+
+    PORTRD |= nRD_setmask;
+    PORTCE |= nCE_setmask;
+
+    return readData;
+}
+
+/*******************************************************************//**
+ * The mapAddress function returns the Z80 address of a 24bit address,
+ * selecting its page in slot 2 first when it is at or above 0x8000.
+ * With the SRAM enabled every address goes to the SRAM in slot 2, bit 14
+ * picks the SRAM bank so 0x0000 and 0x8000 are both the first byte of
+ * the save.
+ **********************************************************************/
+uint16_t sms::mapAddress(uint32_t address)
+{
+    uint8_t conf;
+
+    if( SMS_SramConf )
+    {
+        conf = SMS_CONF_SRAM | ( (uint8_t)( address >> 12 ) & SMS_CONF_SRAM_BANK );
+        if( conf != SMS_SramConf )
+        {
+            umdv1::writeByte16(SMS_CONF_REG_ADDR, conf);
+            SMS_SramConf = conf;
+        }
+        return SMS_SLOT_2_ADDR | ( (uint16_t)address & SMS_SLOT_MASK );
+    }
+
+    if(address < (uint32_t)SMS_SLOT_2_ADDR ){
+        return (uint16_t)address;
+    }
+
+    return setSMSSlotRegister(2, address);
+}
+
+/*******************************************************************//**
+ * The writeByteBurst function writes count consecutive bytes starting
+ * at a 24bit address, the page is selected once per 16KB like
+ * readByteBurst() and only the low address latches are strobed per
+ * byte. Used for SRAM restores, flash needs programByteBuffer().
+ **********************************************************************/
+void sms::writeByteBurst(uint32_t address, uint8_t *buf, uint16_t count)
+{
+    uint16_t chunk, virtualAddress;
+
+    while( count )
+    {
+        chunk = (uint16_t)( ( SMS_SLOT_MASK + 1 ) - ( address & SMS_SLOT_MASK ) );
+        if( chunk > count )
+        {
+            chunk = count;
+        }
+        virtualAddress = mapAddress(address);
+        address += chunk;
+        count -= chunk;
+
+        SET_DATABUS_TO_OUTPUT();
+        while( chunk-- )
+        {
+            DATAOUTH = (uint8_t)(virtualAddress>>8 & 0xFF);
+            DATAOUTL = (uint8_t)(virtualAddress & 0xFF);
+            PORTALE |= ALE_low_setmask;
+            PORTALE &= ALE_low_clrmask;
+            DATAOUTL = *(buf++);
+
+            PORTCE &= nCE_clrmask;
+            PORTWR &= nWR_clrmask;
+            PORTWR &= nWR_clrmask;
+            PORTWR &= nWR_clrmask; // waste 62.5ns - nWR should be low for 125ns
+
+            PORTWR |= nWR_setmask;
+            PORTCE |= nCE_setmask;
+
+            virtualAddress++;
+        }
+        SET_DATABUS_TO_INPUT();
+    }
+}
+
 /*******************************************************************//**
  * The writeByte function strobes a byte into the cartridge at a 24bit
  * address.
@@ -259,12 +439,7 @@ uint8_t sms::readByte(uint32_t address)
 void sms::writeByte(uint32_t address, uint8_t data)
 {
 
-    if(address < (uint32_t)SMS_SLOT_2_ADDR ){
-        latchAddress16((uint16_t)address);
-    }else{
-        //latch the address and set slot 2
-        latchAddress16(setSMSSlotRegister(2, address));
-    }
+    latchAddress16(mapAddress(address));
 
     SET_DATABUS_TO_OUTPUT();
     DATAOUTL = data;
@@ -293,35 +468,127 @@ void sms::writeByte(uint32_t address, uint8_t data)
  * 
  * \warning Sector or entire IC must be erased prior to programming
  **********************************************************************/
-void sms::programByte(uint32_t address, uint8_t data, bool wait)
+sms::status_e sms::programByte(uint32_t address, uint8_t data, bool wait)
 {
+    status_e status = STATUS_OK;
 
     //enable rom write enable bit
     romWrites(true);
 
-    //mx29f800 program byte mode
-    writeByte(0x00000AAA, 0xAA);
-    writeByte16(0x0555, 0x55);
+    //mx29f800 program byte mode, unlock cycles are skipped in bypass mode
+    if( !_bypass )
+    {
+        writeByte(0x00000AAA, 0xAA);
+        writeByte16(0x0555, 0x55);
+    }
     writeByte16(0x0AAA, 0xA0);
 	writeByte(address, data);
 	
-    //disable rom write enable bit
-    romWrites(false);
-
-	//use data polling to validate end of program cycle
+	//use data polling to validate end of program cycle, writes stay
+	//enabled so a failed program can be reset
 	if(wait)
 	{
-		while( toggleBit8(4) != 4 );
+		status = pollByte(address, data, flashID.programTimeout ? flashID.programTimeout : PROGRAM_TIMEOUT);
 	}
+
+    //disable rom write enable bit
+    romWrites(false);
+
+    return status;
+}
+
+/*******************************************************************//**
+ * The programByteBuffer function programs count bytes starting at a
+ * 24bit address like programByte() but the ROM writes stay enabled for
+ * the whole block, and the slot 2 page is only written when the block
+ * crosses into the next page. 0xFF bytes are skipped, it stops at the
+ * first byte that fails and a byte that reads back wrong doesn't stop
+ * the others.
+ **********************************************************************/
+sms::status_e sms::programByteBuffer(uint32_t address, uint8_t *buf, uint16_t count)
+{
+    status_e status, result = STATUS_OK;
+    uint32_t timeout = flashID.programTimeout ? flashID.programTimeout : PROGRAM_TIMEOUT;
+
+    //enable rom write enable bit
+    romWrites(true);
+
+    while( count-- )
+    {
+        // erased flash already reads 0xFF
+        if( *buf != 0xFF )
+        {
+            //mx29f800 program byte mode, unlock cycles are skipped in bypass mode
+            if( !_bypass )
+            {
+                writeByte16(0x0AAA, 0xAA);
+                writeByte16(0x0555, 0x55);
+            }
+            writeByte16(0x0AAA, 0xA0);
+            writeByte(address, *buf);
+
+            status = pollByte(address, *buf, timeout);
+            if( ( status == STATUS_FAIL ) || ( status == STATUS_TIMEOUT ) )
+            {
+                result = status;
+                break;
+            }else if( status == STATUS_VERIFY )
+            {
+                result = status;
+            }
+        }
+        buf++;
+        address++;
+    }
+
+    //disable rom write enable bit
+    romWrites(false);
+
+    return result;
+}
+
+/*******************************************************************//**
+ * The enterBypass() function puts the flash in unlock bypass mode when
+ * getFlashID() found it supports it, with ROM writes enabled for the
+ * duration of the command.
+ **********************************************************************/
+void sms::enterBypass()
+{
+    if( !flashID.bypass || _bypass )
+    {
+        return;
+    }
+
+    romWrites(true);
+    umdv1::enterBypass();
+    romWrites(false);
+}
+
+/*******************************************************************//**
+ * The exitBypass() function returns the flash to read array mode from
+ * unlock bypass mode.
+ **********************************************************************/
+void sms::exitBypass()
+{
+    if( !_bypass )
+    {
+        return;
+    }
+
+    romWrites(true);
+    umdv1::exitBypass();
+    romWrites(false);
 }
 
 /*******************************************************************//**
  * The eraseChip() function erases the entire flash. If the wait parameter
- * is true the function will block with toggle bit until the erase 
- * operation has completed.
+ * is true the function will block with waitChipErase() until the erase
+ * operation has completed or timed out.
  **********************************************************************/
-void sms::eraseChip(bool wait)
+sms::status_e sms::eraseChip(bool wait)
 {
+    status_e status = STATUS_OK;
+
     //enable rom write enable bit
     romWrites(true);
 
@@ -332,36 +599,58 @@ void sms::eraseChip(bool wait)
     writeByte16(0x0AAA, 0xAA);
     writeByte16(0x0555, 0x55);
     writeByte16(0x0AAA, 0x10);
-	
-    //disable rom write enable bit
-    romWrites(false);
 
-	// if wait parameter was specified, do toggle until operation is complete
+	// if wait parameter was specified, poll until operation is complete,
+	// writes stay enabled so a failed erase can be reset
 	if( wait )
 	{
-		// start a timer
-		uint32_t intervalMillis;
-        intervalMillis = millis();
-        
-        // wait for 4 consecutive toggle bit success reads before exiting
-        while( toggleBit8(4) != 4 )
-        {
-            if( (millis() - intervalMillis) > 250 )
-            {
-                //PC side app expects a "." before timeout
-                intervalMillis = millis();
-                Serial.print(".");
-            }
-        }
-        //Send something other than a "." to indicate we are done
-        Serial.print("!");
+        status = waitChipErase();
 	}
+
+    //disable rom write enable bit
+    romWrites(false);
+
+    return status;
+}
+
+/*******************************************************************//**
+ * The eraseSector() function erases the sector holding address, the
+ * sector address goes through the mapper like any other write. If the
+ * wait parameter is true the function will block with data polling until
+ * the erase operation has completed or timed out.
+ **********************************************************************/
+sms::status_e sms::eraseSector(uint32_t address, bool wait)
+{
+    status_e status = STATUS_OK;
+
+    //enable rom write enable bit
+    romWrites(true);
+
+    //mx29f800 sector erase byte mode
+    writeByte16(0x0AAA, 0xAA);
+    writeByte16(0x0555, 0x55);
+    writeByte16(0x0AAA, 0x80);
+    writeByte16(0x0AAA, 0xAA);
+    writeByte16(0x0555, 0x55);
+    writeByte(address, 0x30);
+
+    if( wait )
+    {
+        status = pollByte(address, 0xFF, ( flashID.sectorEraseTimeout ? flashID.sectorEraseTimeout : SECTOR_ERASE_TIMEOUT ) * 1000UL);
+    }
+
+    //disable rom write enable bit
+    romWrites(false);
+
+    return status;
 }
 
 /*******************************************************************//**
  * The setSMSSlotRegister function updates the cartridge slot register
  * with the correct bank number of the corresponding address and 
- * returns the virtual address to read from in the selected slot
+ * returns the virtual address to read from in the selected slot. The
+ * slot 2 page is cached in SMS_SelectedPage and the register is only
+ * written when the page changes.
  **********************************************************************/
 uint16_t sms::setSMSSlotRegister(uint8_t slotNum, uint32_t address)
 {
@@ -379,17 +668,16 @@ uint16_t sms::setSMSSlotRegister(uint8_t slotNum, uint32_t address)
             virtualAddress = (SMS_SLOT_1_ADDR | ( (uint16_t)address & 0x3FFF));
             break;
         case 2:
-            umdv1::writeByte16(SMS_SLOT_2_REG_ADDR, selectedPage);
-            virtualAddress = (SMS_SLOT_2_ADDR | ( (uint16_t)address & 0x3FFF));
-            break;
         default:
-            umdv1::writeByte16(SMS_SLOT_2_REG_ADDR, selectedPage);
+            if( selectedPage != SMS_SelectedPage )
+            {
+                umdv1::writeByte16(SMS_SLOT_2_REG_ADDR, selectedPage);
+                SMS_SelectedPage = selectedPage;
+            }
             virtualAddress = (SMS_SLOT_2_ADDR | ( (uint16_t)address & 0x3FFF));
             break;
     }
     
-    //kind of assumes we're only mapping in 1 slot (#2)
-    SMS_SelectedPage = selectedPage;
     //Serial.println("");
     //Serial.print(F("vadr="));
     //Serial.println(virtualAddress, HEX);
@@ -398,19 +686,23 @@ uint16_t sms::setSMSSlotRegister(uint8_t slotNum, uint32_t address)
 
 /*******************************************************************//**
  * The enableSram() function writes to the conf register to enable
- * the SRAM latch
+ * the SRAM latch, the first SRAM bank is mapped in slot 2. The value is
+ * kept in SMS_SramConf so mapAddress() only writes the register again
+ * to switch SRAM banks.
  **********************************************************************/
 void sms::enableSram(uint8_t param)
 {
-    writeByte16(SMS_CONF_REG_ADDR, 0x88);
+    SMS_SramConf = SMS_CONF_SRAM;
+    writeByte16(SMS_CONF_REG_ADDR, SMS_SramConf);
 }
 
 /*******************************************************************//**
- * The enableSram() function writes to the conf register to disable
- * the SRAM latch
+ * The disableSram() function writes to the conf register to disable
+ * the SRAM latch, slot 2 goes back to the ROM page it held
  **********************************************************************/
 void sms::disableSram(uint8_t param)
 {
+    SMS_SramConf = 0;
     writeByte16(SMS_CONF_REG_ADDR, 0x00);
 }
 
@@ -419,6 +711,8 @@ void sms::disableSram(uint8_t param)
  **********************************************************************/
 void sms::romWrites(bool enable)
 {
+    //the conf register also holds the SRAM enable
+    SMS_SramConf = 0;
     if(enable){
         writeByte16(SMS_CONF_REG_ADDR, 0x80);
     }else{
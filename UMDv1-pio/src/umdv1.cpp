@@ -107,6 +107,8 @@ void umdv1::setup(uint8_t param)
     pinMode(CTRL6, INPUT);
     pinMode(CTRL7, INPUT);
 
+    // high address latch content is unknown until the next latchAddress32
+    _latchedHighValid = false;
 }
 
 /*******************************************************************//**
@@ -184,6 +186,226 @@ uint32_t umdv1::getFlashSizeFromID(uint8_t manufacturer, uint8_t device)
     return size;
 }
 
+/*******************************************************************//**
+ * The cfiMaxTime() function turns a CFI typical time exponent and max
+ * time multiplier exponent into a max time, saturated at 2^limit. A
+ * typical time of 0 means the operation is not supported.
+ **********************************************************************/
+static uint32_t cfiMaxTime(uint8_t typical, uint8_t multiplier, uint8_t limit)
+{
+    if( typical == 0 )
+    {
+        return 0;
+    }
+    if( ( typical + multiplier ) > limit )
+    {
+        return (uint32_t)1 << limit;
+    }
+    return (uint32_t)1 << ( typical + multiplier );
+}
+
+/*******************************************************************//**
+ * The queryCFI() function reads the Common Flash Interface query of
+ * the flash. Top boot AMD style devices list their erase regions in
+ * bottom boot order, they are reversed so the regions always go from
+ * the bottom of the array up.
+ **********************************************************************/
+bool umdv1::queryCFI()
+{
+    uint8_t i, n, bootFlag = 0;
+    uint16_t pri, count;
+    uint32_t size;
+
+    flashID.cfi = false;
+    flashID.bypass = false;
+    flashID.programTimeout = 0;
+    flashID.bufferTimeout = 0;
+    flashID.sectorEraseTimeout = 0;
+    flashID.chipEraseTimeout = 0;
+    flashID.regions = 0;
+
+    writeCFI(0x55, 0x98);
+    if( ( readCFI(0x10) != 'Q' ) || ( readCFI(0x11) != 'R' ) || ( readCFI(0x12) != 'Y' ) )
+    {
+        writeCFI(0x00, 0xF0);
+        return false;
+    }
+
+    flashID.cfi = true;
+    flashID.size = (uint32_t)1 << readCFI(0x27);
+
+    // AMD/Spansion and Macronix CFI parts all implement unlock bypass
+    flashID.bypass = ( flashID.manufacturer == 0x01 ) || ( flashID.manufacturer == 0xC2 );
+
+    // typical times are 2^n, max times are 2^n times the typical time
+    flashID.programTimeout = cfiMaxTime(readCFI(0x1F), readCFI(0x23), 15);
+    flashID.bufferTimeout = cfiMaxTime(readCFI(0x20), readCFI(0x24), 15);
+    flashID.sectorEraseTimeout = cfiMaxTime(readCFI(0x21), readCFI(0x25), 15);
+    // 2^22ms is the most that still fits a 32bit timeout in us
+    flashID.chipEraseTimeout = cfiMaxTime(readCFI(0x22), readCFI(0x26), 22);
+
+    // write buffer, only usable if it has a program time
+    n = readCFI(0x2A);
+    if( n && flashID.bufferTimeout )
+    {
+        flashID.buffermode = 1;
+        flashID.bufferSize = (uint16_t)1 << n;
+    }
+
+    flashID.regions = readCFI(0x2C);
+    if( flashID.regions > CFI_MAX_REGIONS )
+    {
+        flashID.regions = 0;
+    }
+    for( i = 0; i < flashID.regions; i++ )
+    {
+        flashID.region[i].count = ( readCFI(0x2D + 4*i) | ( (uint16_t)readCFI(0x2E + 4*i) << 8 ) ) + 1;
+        flashID.region[i].size = ( readCFI(0x2F + 4*i) | ( (uint32_t)readCFI(0x30 + 4*i) << 8 ) ) << 8;
+    }
+
+    // AMD primary extended query holds the boot block location
+    pri = readCFI(0x15) | ( (uint16_t)readCFI(0x16) << 8 );
+    if( ( pri < 0xF0 ) && ( readCFI(pri) == 'P' ) && ( readCFI(pri + 1) == 'R' ) && ( readCFI(pri + 2) == 'I' ) )
+    {
+        bootFlag = readCFI(pri + 0x0F);
+    }
+
+    writeCFI(0x00, 0xF0);
+
+    if( bootFlag == 0x03 )
+    {
+        for( i = 0; i < ( flashID.regions >> 1 ); i++ )
+        {
+            n = flashID.regions - 1 - i;
+            count = flashID.region[i].count;
+            size = flashID.region[i].size;
+            flashID.region[i].count = flashID.region[n].count;
+            flashID.region[i].size = flashID.region[n].size;
+            flashID.region[n].count = count;
+            flashID.region[n].size = size;
+        }
+    }
+
+    return true;
+}
+
+/*******************************************************************//**
+ * The writeCFI() function writes a command at a CFI offset in byte mode,
+ * word offsets are doubled. Mirrored carts have the flash data bits
+ * reversed so the command is reversed too.
+ **********************************************************************/
+void umdv1::writeCFI(uint8_t offset, uint8_t data)
+{
+    if( info.mirrored_bus )
+    {
+        data = mirror_byte(data);
+    }
+    writeByte((uint32_t)offset << 1, data);
+}
+
+/*******************************************************************//**
+ * The readCFI() function reads a CFI query byte in byte mode, word
+ * offsets are doubled. The byte is reversed back on mirrored carts.
+ **********************************************************************/
+uint8_t umdv1::readCFI(uint8_t offset)
+{
+    uint8_t data = readByte((uint32_t)offset << 1);
+
+    if( info.mirrored_bus )
+    {
+        data = mirror_byte(data);
+    }
+    return data;
+}
+
+/*******************************************************************//**
+ * The getSectorSize() function returns the size of the erase sector
+ * holding an address from the CFI erase regions, or for parts without
+ * CFI from the table below. Boot block devices have small sectors at one end
+ * of the array, the T devices at the top and the B devices at the bottom,
+ * counted from that end the layout is the same for both so only the
+ * offset changes. Sectors are always aligned on their size.
+ **********************************************************************/
+uint32_t umdv1::getSectorSize(uint32_t address)
+{
+    uint32_t offset = 0;
+    bool eightBoot = false;
+    uint8_t i;
+
+    // walk the erase regions from the bottom of the array
+    if( flashID.regions )
+    {
+        for( i = 0; i < flashID.regions; i++ )
+        {
+            if( ( address - offset ) < ( flashID.region[i].count * flashID.region[i].size ) )
+            {
+                return flashID.region[i].size;
+            }
+            offset += flashID.region[i].count * flashID.region[i].size;
+        }
+        return 0;
+    }
+
+    switch( flashID.manufacturer )
+    {
+        // macronix
+        case 0xC2:
+            switch( flashID.device )
+            {
+                // 8 x 8KB boot sectors
+                case 0xC9: // MX29LV640ET
+                case 0xA7: // MX29LV320ET
+                    offset = flashID.size - 1 - address;
+                    eightBoot = true;
+                    break;
+                case 0xCB: // MX29LV640EB
+                case 0xA8: // MX29LV320EB
+                    offset = address;
+                    eightBoot = true;
+                    break;
+                // 16KB, 8KB, 8KB, 32KB boot sectors
+                case 0xC4: // MX29LV160DT
+                case 0x58: // MX29F800CT
+                case 0x23: // MX29F400CT
+                case 0x51: // MX29F200CT
+                    offset = flashID.size - 1 - address;
+                    break;
+                case 0x49: // MX29LV160DB
+                case 0xD6: // MX29F800CB
+                case 0xAB: // MX29F400CB
+                case 0x57: // MX29F200CB
+                    offset = address;
+                    break;
+                default:
+                    return 0;
+            }
+            break;
+
+        // SST parts have uniform 4KB sectors but their chip erase is
+        // faster than erasing a range of them, leave them to eraseChip()
+        default:
+            return 0;
+    }
+
+    if( offset >= 0x10000 )
+    {
+        return 0x10000;
+    }
+    if( eightBoot )
+    {
+        return 0x2000;
+    }
+    if( offset < 0x4000 )
+    {
+        return 0x4000;
+    }
+    if( offset < 0x8000 )
+    {
+        return 0x2000;
+    }
+    return 0x8000;
+}
+
 /*******************************************************************//**
  * The _latchAddress function latches a 24bit address to the cartridge
  * \warning contains direct port manipulation
@@ -217,6 +439,10 @@ void umdv1::latchAddress32(uint32_t address)
     //digitalWrite(ALE_high, LOW);
     PORTALE &= ALE_high_clrmask;
     
+    //remember what the high latch holds for the burst reads
+    _latchedHigh = addrh;
+    _latchedHighValid = true;
+    
     //without this additional 0x00 write reads to undefined regions would
     //return the last value written to DATAOUTL
     //DATAOUTL = 0x00; // commenting this out fixed the s29gl032 problems - dunno why yet
@@ -265,6 +491,8 @@ void umdv1::getFlashID(void)
     flashID.device = 0;
     flashID.type = 0;
     flashID.size = 0;
+    flashID.buffermode = 0;
+    flashID.bufferSize = 0;
           
     //mx29f800 software ID detect byte mode
     // enter software ID mode
@@ -277,17 +505,20 @@ void umdv1::getFlashID(void)
     flashID.device = readByte((uint32_t)0x0002);
     // exit software ID mode
     writeByte((uint32_t)0x0000, 0xF0);
-    // figure out the size
-    flashID.size = getFlashSizeFromID( flashID.manufacturer, flashID.device );
+    // figure out the size, from the table for parts without CFI
+    if( !queryCFI() )
+    {
+        flashID.size = getFlashSizeFromID( flashID.manufacturer, flashID.device );
+    }
 
 }
 
 /*******************************************************************//**
  * The eraseChip() function erases the entire flash. If the wait parameter
- * is true the function will block with toggle bit until the erase 
- * operation has completed.
+ * is true the function will block with waitChipErase() until the erase
+ * operation has completed or timed out.
  **********************************************************************/
-void umdv1::eraseChip(bool wait)
+umdv1::status_e umdv1::eraseChip(bool wait)
 {
 
     //mx29f800 chip erase byte mode
@@ -298,28 +529,84 @@ void umdv1::eraseChip(bool wait)
     writeByte16(0x0555, 0x55);
     writeByte16(0x0AAA, 0x10);
 	
-	// if wait parameter was specified, do toggle until operation is complete
+	// if wait parameter was specified, poll until operation is complete
 	if( wait )
 	{
-		// start a timer
-		uint32_t intervalMillis;
-        intervalMillis = millis();
-        
-        // wait for 4 consecutive toggle bit success reads before exiting
-        while( toggleBit8(4) != 4 )
-        {
-            if( (millis() - intervalMillis) > 250 )
-            {
-                // flash to show progress
-                digitalWrite(nLED, !digitalRead(nLED));
-                //PC side app expects a "." before timeout
-                intervalMillis = millis();
-                Serial.print(".");
-            }
-        }
-        //Send something other than a "." to indicate we are done
-        Serial.print("!");
+        return waitChipErase();
 	}
+
+    return STATUS_OK;
+}
+
+/*******************************************************************//**
+ * The waitChipErase() function waits for a chip erase with data polling
+ * like eraseSector(), so a dead cartridge times out instead of toggling
+ * forever. The text progress runs as the pollIdle work.
+ **********************************************************************/
+umdv1::status_e umdv1::waitChipErase()
+{
+    void (*idle)() = pollIdle;
+    uint32_t timeout;
+    status_e status;
+
+    timeout = ( flashID.chipEraseTimeout ? flashID.chipEraseTimeout : CHIP_ERASE_TIMEOUT ) * 1000UL;
+
+    pollIdle = chipEraseProgress;
+    if( info.bus_size == 16 )
+    {
+        status = pollWord(0, 0xFFFF, timeout);
+    }else
+    {
+        status = pollByte(0, 0xFF, timeout);
+    }
+    pollIdle = idle;
+
+    //Send something other than a "." to indicate we are done
+    Serial.print("!");
+
+    return status;
+}
+
+/*******************************************************************//**
+ * The chipEraseProgress() function flashes the LED and prints a "."
+ * every 250ms while waitChipErase() polls.
+ **********************************************************************/
+void umdv1::chipEraseProgress()
+{
+    static uint32_t intervalMillis;
+
+    if( (millis() - intervalMillis) > 250 )
+    {
+        // flash to show progress
+        digitalWrite(nLED, !digitalRead(nLED));
+        //PC side app expects a "." before timeout
+        intervalMillis = millis();
+        Serial.print(".");
+    }
+}
+
+/*******************************************************************//**
+ * The eraseSector() function erases the sector holding address. If the
+ * wait parameter is true the function will block with data polling until
+ * the erase operation has completed or timed out.
+ **********************************************************************/
+umdv1::status_e umdv1::eraseSector(uint32_t address, bool wait)
+{
+
+    //mx29f800 sector erase byte mode
+    writeByte((uint32_t)0x00000AAA, 0xAA);
+    writeByte16(0x0555, 0x55);
+    writeByte16(0x0AAA, 0x80);
+    writeByte16(0x0AAA, 0xAA);
+    writeByte16(0x0555, 0x55);
+    writeByte(address, 0x30);
+
+    if( wait )
+    {
+        return pollByte(address, 0xFF, ( flashID.sectorEraseTimeout ? flashID.sectorEraseTimeout : SECTOR_ERASE_TIMEOUT ) * 1000UL);
+    }
+
+    return STATUS_OK;
 }
 
 /*******************************************************************//**
@@ -379,6 +666,180 @@ uint8_t umdv1::toggleBit16(uint8_t attempts)
     return retValue;
 }
 
+/*******************************************************************//**
+ * The pollByte() function waits for a program or erase operation with
+ * DQ7 data polling. The first read latches the address through the
+ * cartridge's readByte(), every following read only strobes nCE and nRD.
+ * DQ7 reads the complement of data until the operation completes, DQ5
+ * set while DQ7 is still wrong means the flash gave up and needs a
+ * reset, unlock bypass mode is left first as it ignores the reset.
+ * Mirrored carts have DQ7 and DQ5 on data bits 0 and 2. Once
+ * DQ7 is valid the other bits are read once more, still at the latched
+ * address, and compared with data. pollIdle runs between reads while the
+ * flash is busy.
+ **********************************************************************/
+umdv1::status_e umdv1::pollByte(uint32_t address, uint8_t data, uint32_t timeout)
+{
+    uint8_t readValue, dq7 = 0x80, dq5 = 0x20;
+    uint8_t reads = 0;
+    uint32_t start = micros();
+
+    if( info.mirrored_bus )
+    {
+        dq7 = 0x01;
+        dq5 = 0x04;
+    }
+
+    readValue = readByte(address);
+    while( ( readValue ^ data ) & dq7 )
+    {
+        if( readValue & dq5 )
+        {
+            // DQ7 may have changed with DQ5, read it once more
+            if( ( readLatchedByte() ^ data ) & dq7 )
+            {
+                // the reset is ignored in unlock bypass mode, leave it first
+                if( _bypass )
+                {
+                    writeByte16(0x0000, 0x90);
+                    writeByte16(0x0000, 0x00);
+                    _bypass = false;
+                }
+                writeByte16(0x0000, 0xF0);
+                return STATUS_FAIL;
+            }
+            break;
+        }
+
+        // micros() is slower than a read, only check it every 16 reads
+        if( ( ( ++reads & 0x0F ) == 0 ) && ( ( micros() - start ) > timeout ) )
+        {
+            return STATUS_TIMEOUT;
+        }
+
+        // the latches keep the address while the idle work runs
+        if( pollIdle != NULL )
+        {
+            pollIdle();
+        }
+        readValue = readLatchedByte();
+    }
+
+    // the other bits can become valid after DQ7
+    if( readLatchedByte() != data )
+    {
+        return STATUS_VERIFY;
+    }
+
+    return STATUS_OK;
+}
+
+/*******************************************************************//**
+ * The pollWord() function waits for a program or erase operation with
+ * DQ7 data polling in word mode, see pollByte(). readWord() puts DQ0-7
+ * in the high byte.
+ **********************************************************************/
+umdv1::status_e umdv1::pollWord(uint32_t address, uint16_t data, uint32_t timeout)
+{
+    uint16_t readValue;
+    uint8_t reads = 0;
+    uint32_t start = micros();
+
+    readValue = readWord(address);
+    while( ( readValue ^ data ) & 0x8000 )
+    {
+        if( readValue & 0x2000 )
+        {
+            // DQ7 may have changed with DQ5, read it once more
+            if( ( readLatchedWord() ^ data ) & 0x8000 )
+            {
+                // the reset is ignored in unlock bypass mode, leave it first
+                if( _bypass )
+                {
+                    writeWord16(0x0000, 0x9000);
+                    writeWord16(0x0000, 0x0000);
+                    _bypass = false;
+                }
+                writeWord16(0x0000, 0xF000);
+                return STATUS_FAIL;
+            }
+            break;
+        }
+
+        // micros() is slower than a read, only check it every 16 reads
+        if( ( ( ++reads & 0x0F ) == 0 ) && ( ( micros() - start ) > timeout ) )
+        {
+            return STATUS_TIMEOUT;
+        }
+
+        // the latches keep the address while the idle work runs
+        if( pollIdle != NULL )
+        {
+            pollIdle();
+        }
+        readValue = readLatchedWord();
+    }
+
+    // the other bits can become valid after DQ7
+    if( readLatchedWord() != data )
+    {
+        return STATUS_VERIFY;
+    }
+
+    return STATUS_OK;
+}
+
+/*******************************************************************//**
+ * The readLatchedByte() function reads a byte without latching an
+ * address, the latches still hold the last one.
+ * 
+ * \warning contains direct port manipulation
+ **********************************************************************/
+uint8_t umdv1::readLatchedByte()
+{
+    uint8_t readData;
+
+    SET_DATABUS_TO_INPUT();
+
+    PORTCE &= nCE_clrmask;
+    PORTRD &= nRD_clrmask;
+    PORTRD &= nRD_clrmask;
+    PORTRD &= nRD_clrmask; // wait an additional 62.5ns. ROM is slow;
+
+    readData = DATAINL;
+
+    PORTRD |= nRD_setmask;
+    PORTCE |= nCE_setmask;
+
+    return readData;
+}
+
+/*******************************************************************//**
+ * The readLatchedWord() function reads a word without latching an
+ * address, the latches still hold the last one.
+ * 
+ * \warning contains direct port manipulation, converts to little endian
+ **********************************************************************/
+uint16_t umdv1::readLatchedWord()
+{
+    uint16_t readData;
+
+    SET_DATABUS_TO_INPUT();
+
+    PORTCE &= nCE_clrmask;
+    PORTRD &= nRD_clrmask;
+    PORTRD &= nRD_clrmask; // wait an additional 62.5ns. ROM is slow,
+
+    readData = (uint16_t)DATAINL;
+    readData <<= 8;
+    readData |= (uint16_t)(DATAINH & 0x00FF);
+
+    PORTRD |= nRD_setmask;
+    PORTCE |= nCE_setmask;
+
+    return readData;
+}
+
 /*******************************************************************//**
  * The readByte(uint16_t) function returns a byte read from 
  * a 16bit address.
@@ -511,6 +972,95 @@ uint16_t umdv1::readWord(uint32_t address)
     return readData;
 }
 
+/*******************************************************************//**
+ * The readByteBurst function reads count consecutive bytes starting at
+ * a 24bit address. The high address latch is only strobed when bits
+ * 23..16 differ from what it already holds, every other byte only needs
+ * the low latch.
+ * 
+ * \warning contains direct port manipulation
+ **********************************************************************/
+void umdv1::readByteBurst(uint32_t address, uint8_t *buf, uint16_t count)
+{
+    uint8_t addrh;
+
+    while( count-- )
+    {
+        addrh = (uint8_t)(address>>16 & 0xFF);
+        if( !_latchedHighValid || ( addrh != _latchedHigh ) )
+        {
+            latchAddress32(address);
+        }else
+        {
+            SET_DATABUS_TO_OUTPUT();
+            DATAOUTH = (uint8_t)(address>>8 & 0xFF);
+            DATAOUTL = (uint8_t)(address & 0xFF);
+            PORTALE |= ALE_low_setmask;
+            PORTALE &= ALE_low_clrmask;
+            SET_DATABUS_TO_INPUT();
+        }
+
+        PORTCE &= nCE_clrmask;
+        PORTRD &= nRD_clrmask;
+        PORTRD &= nRD_clrmask;
+        PORTRD &= nRD_clrmask; // wait an additional 62.5ns. ROM is slow;
+
+        *(buf++) = DATAINL;
+
+        PORTRD |= nRD_setmask;
+        PORTCE |= nCE_setmask;
+
+        address++;
+    }
+}
+
+/*******************************************************************//**
+ * The readWordBurst function reads count consecutive words starting at
+ * a 24bit address. The high address latch is only strobed when bits
+ * 23..16 differ from what it already holds, i.e. once every 64KB
+ * during a sequential dump.
+ * 
+ * \warning converts to little endian
+ * \warning contains direct port manipulation
+ **********************************************************************/
+void umdv1::readWordBurst(uint32_t address, uint16_t *buf, uint16_t count)
+{
+    uint16_t readData;
+    uint8_t addrh;
+
+    while( count-- )
+    {
+        addrh = (uint8_t)(address>>16 & 0xFF);
+        if( !_latchedHighValid || ( addrh != _latchedHigh ) )
+        {
+            latchAddress32(address);
+        }else
+        {
+            SET_DATABUS_TO_OUTPUT();
+            DATAOUTH = (uint8_t)(address>>8 & 0xFF);
+            DATAOUTL = (uint8_t)(address & 0xFF);
+            PORTALE |= ALE_low_setmask;
+            PORTALE &= ALE_low_clrmask;
+            SET_DATABUS_TO_INPUT();
+        }
+
+        PORTCE &= nCE_clrmask;
+        PORTRD &= nRD_clrmask;
+        PORTRD &= nRD_clrmask; // wait an additional 62.5ns. ROM is slow,
+
+        //convert to little endian while reading
+        readData = (uint16_t)DATAINL;
+        readData <<= 8;
+        readData |= (uint16_t)(DATAINH & 0x00FF);
+        *(buf++) = readData;
+
+        PORTRD |= nRD_setmask;
+        PORTCE |= nCE_setmask;
+
+        address += 2;
+    }
+}
+
 /*******************************************************************//**
  * The writeWord function strobes a word into the cartridge at a 16bit
  * address.
@@ -637,6 +1187,18 @@ void umdv1::writeByte(uint32_t address, uint8_t data)
     
 }
 
+/*******************************************************************//**
+ * The writeByteBurst function writes count consecutive bytes starting
+ * at a 24bit address, one writeByte() each
+ **********************************************************************/
+void umdv1::writeByteBurst(uint32_t address, uint8_t *buf, uint16_t count)
+{
+    while( count-- )
+    {
+        writeByte(address++, *(buf++));
+    }
+}
+
 /*******************************************************************//**
  * The programByte function programs a byte into the flash array at a
  * 24bit address. If the wait parameter is true the function will wait 
@@ -645,12 +1207,15 @@ void umdv1::writeByte(uint32_t address, uint8_t data)
  * 
  * \warning Sector or entire IC must be erased prior to programming
  **********************************************************************/
-void umdv1::programByte(uint32_t address, uint8_t data, bool wait)
+umdv1::status_e umdv1::programByte(uint32_t address, uint8_t data, bool wait)
 {
 	
-    //mx29f800 program byte mode
-    writeByte((uint32_t)0x00000AAA, 0xAA);
-    writeByte16(0x0555, 0x55);
+    //mx29f800 program byte mode, unlock cycles are skipped in bypass mode
+    if( !_bypass )
+    {
+        writeByte((uint32_t)0x00000AAA, 0xAA);
+        writeByte16(0x0555, 0x55);
+    }
     writeByte16(0x0AAA, 0xA0);
 	
 	//write the data
@@ -659,9 +1224,10 @@ void umdv1::programByte(uint32_t address, uint8_t data, bool wait)
 	//use data polling to validate end of program cycle
 	if(wait)
 	{
-		while( toggleBit8(2) != 2 );
+		return pollByte(address, data, flashID.programTimeout ? flashID.programTimeout : PROGRAM_TIMEOUT);
 	}
 	
+	return STATUS_OK;
 }
 
 /*******************************************************************//**
@@ -672,10 +1238,14 @@ void umdv1::programByte(uint32_t address, uint8_t data, bool wait)
  * 
  * \warning Sector or entire IC must be erased prior to programming
  **********************************************************************/
-void umdv1::programWord(uint32_t address, uint16_t data, bool wait)
+umdv1::status_e umdv1::programWord(uint32_t address, uint16_t data, bool wait)
 {
-    writeWord( (uint32_t)(0x000555 << 1), 0xAA00);
-	writeWord16((0x02AA << 1), 0x5500);
+    //unlock cycles are skipped in bypass mode
+    if( !_bypass )
+    {
+        writeWord( (uint32_t)(0x000555 << 1), 0xAA00);
+        writeWord16((0x02AA << 1), 0x5500);
+    }
     writeWord16((0x0555 << 1), 0xA000);
     
     //write the data
@@ -684,8 +1254,109 @@ void umdv1::programWord(uint32_t address, uint16_t data, bool wait)
 
     //use data polling to validate end of program cycle
 	if(wait){
-		while( toggleBit16(2) != 2 );
+		return pollWord(address, data, flashID.programTimeout ? flashID.programTimeout : PROGRAM_TIMEOUT);
 	}
+	
+	return STATUS_OK;
+}
+
+/*******************************************************************//**
+ * The enterBypass() function puts the flash in unlock bypass mode when
+ * getFlashID() found it supports it, every program command then only
+ * takes the 0xA0 cycle and the data cycle. Byte mode commands.
+ **********************************************************************/
+void umdv1::enterBypass()
+{
+    if( !flashID.bypass || _bypass )
+    {
+        return;
+    }
+
+    writeByte((uint32_t)0x00000AAA, 0xAA);
+    writeByte16(0x0555, 0x55);
+    writeByte16(0x0AAA, 0x20);
+    _bypass = true;
+}
+
+/*******************************************************************//**
+ * The restoreBanks() function does nothing, the base cartridge has no
+ * bank mapper.
+ **********************************************************************/
+void umdv1::restoreBanks()
+{
+}
+
+/*******************************************************************//**
+ * The exitBypass() function returns the flash to read array mode from
+ * unlock bypass mode, the reset command is ignored in bypass mode.
+ **********************************************************************/
+void umdv1::exitBypass()
+{
+    if( !_bypass )
+    {
+        return;
+    }
+
+    writeByte16(0x0000, 0x90);
+    writeByte16(0x0000, 0x00);
+    _bypass = false;
+}
+
+/*******************************************************************//**
+ * The programWordBuffer function programs count words starting at a
+ * 24bit address. Without a write buffer they are programmed one at a
+ * time, stopping at the first one that fails. A word that reads back
+ * wrong doesn't stop the others.
+ **********************************************************************/
+umdv1::status_e umdv1::programWordBuffer(uint32_t address, uint16_t *buf, uint16_t count)
+{
+    status_e status, result = STATUS_OK;
+
+    while( count-- )
+    {
+        status = programWord(address, *(buf++), true);
+        if( ( status == STATUS_FAIL ) || ( status == STATUS_TIMEOUT ) )
+        {
+            return status;
+        }else if( status == STATUS_VERIFY )
+        {
+            result = status;
+        }
+        address += 2;
+    }
+
+    return result;
+}
+
+/*******************************************************************//**
+ * The programByteBuffer function programs count bytes starting at a
+ * 24bit address one at a time, skipping the 0xFF bytes and stopping at
+ * the first one that fails. A byte that reads back wrong doesn't stop
+ * the others.
+ **********************************************************************/
+umdv1::status_e umdv1::programByteBuffer(uint32_t address, uint8_t *buf, uint16_t count)
+{
+    status_e status, result = STATUS_OK;
+
+    while( count-- )
+    {
+        // erased flash already reads 0xFF
+        if( *buf != 0xFF )
+        {
+            status = programByte(address, *buf, true);
+            if( ( status == STATUS_FAIL ) || ( status == STATUS_TIMEOUT ) )
+            {
+                return status;
+            }else if( status == STATUS_VERIFY )
+            {
+                result = status;
+            }
+        }
+        buf++;
+        address++;
+    }
+
+    return result;
 }
 
 void umdv1::writeByteTime(uint32_t address, uint8_t data)